@@ -0,0 +1,245 @@
+// Clocksource and one-shot scheduler timer.
+//
+// Time is read from the TSC, calibrated against the 8254 PIT
+// at boot. There is no periodic tick: each cpu arms its lapic
+// timer in one-shot mode for the end of the running process's
+// time slice, and an idle cpu leaves it stopped. cpu 0 also
+// arms it for the next expiry on the timer wheel (timer.c).
+// ticks advances whenever a cpu takes a timer interrupt, or
+// someone needs the current tick (see clockupdate), and so does
+// the timer wheel, which has a finer clock of its own.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "traps.h"
+
+#define PIT_HZ     1193182  // 8254 input clock
+#define PIT_CTRL   0x43
+#define PIT_CH2    0x42
+#define PIT_GATE   0x61     // bit 0 gates channel 2, bit 5 is its output
+
+#define MAXARM     1000000  // longest one-shot, in microseconds
+
+static uint64 tscbase;      // TSC at boot
+static uint usmult;         // 2^32 / TSC cycles per microsecond
+static uint lapicperus;     // lapic timer counts per microsecond
+static uint64 nexttick;     // clocknow() at which ticks advances
+static uint64 wheelat;      // clocknow() of the next timer wheel expiry, 0 if none
+
+// nexttick and wheelat change under tickslock, but the timer
+// interrupt reads them without it: clockseq is odd while they
+// change, and readers retry if it moved, see clockread().
+static volatile uint clockseq;
+
+// Measure the TSC and lapic timer rates over one tick of the PIT.
+// Runs on the boot cpu, after lapicinit().
+void
+clockinit(void)
+{
+  uint64 t0, t1;
+  uint l0, l1, tscperus, count;
+
+  count = PIT_HZ / HZ;
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(PIT_CTRL, 0xB0);  // channel 2, lobyte/hibyte, count down once
+  outb(PIT_CH2, count & 0xFF);
+  outb(PIT_CH2, count >> 8);
+  lapiconeshot(0xFFFFFFFF);
+  t0 = rdtsc();
+  l0 = lapiccount();
+  while((inb(PIT_GATE) & 0x20) == 0)
+    ;
+  t1 = rdtsc();
+  l1 = lapiccount();
+  lapiconeshot(0);
+
+  tscperus = (uint)(t1 - t0) / TICKUS;
+  if(tscperus == 0)
+    tscperus = 1;
+  usmult = 0xFFFFFFFF / tscperus;
+  lapicperus = (l0 - l1) / TICKUS;
+  if(lapicperus == 0)
+    lapicperus = 1;
+  tscbase = t1;
+  nexttick = TICKUS;
+}
+
+// Microseconds since boot.
+uint64
+clocknow(void)
+{
+  uint64 d = rdtsc() - tscbase;
+
+  // d * usmult / 2^32, in two halves so the product can't overflow.
+  return (uint64)(uint)(d >> 32) * usmult +
+         (((uint64)(uint)d * usmult) >> 32);
+}
+
+// Snapshot nexttick and wheelat without tickslock.
+// Returns the clockseq the snapshot is from.
+static uint
+clockread(uint64 *next, uint64 *wheel)
+{
+  uint seq;
+
+  for(;;){
+    seq = clockseq;
+    __sync_synchronize();
+    *next = nexttick;
+    *wheel = wheelat;
+    __sync_synchronize();
+    if((seq & 1) == 0 && seq == clockseq)
+      return seq;
+  }
+}
+
+// Advance ticks to the current time, and run the timer
+// wheel if it is due.
+// Caller must hold tickslock.
+void
+clockupdate(void)
+{
+  uint64 now = clocknow();
+  uint64 when;
+
+  if(now < nexttick && (wheelat == 0 || now < wheelat))
+    return;
+  clockseq++;
+  __sync_synchronize();
+  while(now >= nexttick){
+    nexttick += TICKUS;
+    ticks++;
+  }
+  timerrun(now);
+  wheelat = timernext(&when) ? when : 0;
+  __sync_synchronize();
+  clockseq++;
+}
+
+// Arm the lapic timer of this cpu for the end of its time
+// slice or the next replenishment of a throttled deadline task,
+// and on cpu 0 also for the next timer wheel expiry.
+// Stop it if there is neither.
+void
+clockarm(void)
+{
+  struct cpu *c;
+  uint64 when, now, next, wheel;
+  uint seq;
+
+  pushcli();
+  c = mycpu();
+  when = c->sliceend;
+  if(c->dlwake && (when == 0 || c->dlwake < when))
+    when = c->dlwake;
+  if(c == &cpus[0]){
+    // If clockkick() moves wheelat after our snapshot, either it
+    // sees our armed and sends an IPI, or we see the new clockseq.
+    for(;;){
+      seq = clockread(&next, &wheel);
+      c->armed = when;
+      if(wheel && (when == 0 || wheel < when))
+        c->armed = wheel;
+      __sync_synchronize();
+      if(seq == clockseq)
+        break;
+    }
+    when = c->armed;
+  } else
+    c->armed = when;
+
+  if(when == 0)
+    lapiconeshot(0);
+  else {
+    now = clocknow();
+    if(when <= now)
+      lapiconeshot(1);
+    else if(when - now > MAXARM)
+      lapiconeshot(MAXARM * lapicperus);
+    else
+      lapiconeshot((uint)(when - now) * lapicperus);
+  }
+  popcli();
+}
+
+// Give the process about to run on this cpu a slice of us microseconds.
+void
+clockslice(uint us)
+{
+  pushcli();
+  mycpu()->sliceend = clocknow() + us;
+  clockarm();
+  popcli();
+}
+
+// Is the slice of the running process over, or
+// does a deadline task need the cpu?
+int
+clockexpired(void)
+{
+  struct cpu *c;
+  uint64 now;
+  int expired;
+
+  pushcli();
+  c = mycpu();
+  now = clocknow();
+  expired = c->preempt || now >= c->sliceend ||
+            (c->dlwake && now >= c->dlwake);
+  popcli();
+  return expired;
+}
+
+// Timer interrupt. Bring ticks up to date and re-arm the timer,
+// unless the running slice is over: then trap() yields and the
+// scheduler arms the timer for the next process.
+void
+clockintr(void)
+{
+  struct cpu *c = mycpu();
+  uint64 next, wheel;
+
+  // Most interrupts end a slice within a tick; only take
+  // tickslock when ticks has to advance or the wheel is due.
+  clockread(&next, &wheel);
+  if(clocknow() >= next || (wheel && clocknow() >= wheel)){
+    acquire(&tickslock);
+    clockupdate();
+    release(&tickslock);
+  }
+  if(c->proc == 0){
+    // The scheduler arms the timer when it picks again.
+    c->sliceend = 0;
+    c->dlwake = 0;
+  } else if(clockexpired())
+    return;
+  clockarm();
+}
+
+// A timer was added to the wheel for clocknow() value when.
+// Make cpu 0 re-arm if it would otherwise expire late.
+// Caller must hold tickslock.
+void
+clockkick(uint64 when)
+{
+  struct cpu *c = &cpus[0];
+
+  if(wheelat == 0 || when < wheelat){
+    clockseq++;
+    __sync_synchronize();
+    wheelat = when;
+    __sync_synchronize();
+    clockseq++;
+    __sync_synchronize();
+  }
+  if(c->armed != 0 && c->armed <= when)
+    return;
+  c->armed = when;
+  if(c != mycpu())
+    lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+}
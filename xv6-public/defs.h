@@ -1,10 +1,13 @@
 struct buf;
 struct context;
 struct file;
+struct files;
 struct inode;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct schedstats;
+struct mlfqparam;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -16,6 +19,16 @@ struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 
+// clock.c
+void            clockarm(void);
+int             clockexpired(void);
+void            clockinit(void);
+void            clockintr(void);
+void            clockkick(uint64);
+uint64          clocknow(void);
+void            clockslice(uint);
+void            clockupdate(void);
+
 // console.c
 void            consoleinit(void);
 void            cprintf(char*, ...);
@@ -33,6 +46,14 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+struct files*   filescopy(struct files*);
+struct files*   filesdup(struct files*);
+void            filesput(struct files*);
+
+// futex.c
+int             futex_wait(uint, int);
+int             futex_wake(uint, int);
+void            futexinit(void);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -77,6 +98,9 @@ void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
+void            lapicipi(int, int);
+uint            lapiccount(void);
+void            lapiconeshot(uint);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
@@ -103,22 +127,31 @@ int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+void            balancetick(void);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             getschedstats(struct schedstats*);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+void            pidonate(struct proc*, void*);
 void            pinit(void);
+void            piundo(struct proc*, void*);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+char*           uaddr(uint);
+int             uvalid(uint, uint);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+void            wakeupio(void*);
+void            wakeuppeer(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 int				thread_create(thread_t* thread, void* (*start_routine)(void *), void* arg);
 void			thread_exit(void* retval);
@@ -160,7 +193,9 @@ int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
-void            timerinit(void);
+int             timernext(uint64*);
+void            timerrun(uint64);
+int             timersleep(uint64);
 
 // trap.c
 void            idtinit(void);
@@ -193,6 +228,15 @@ void            clearpteu(pde_t *pgdir, char *uva);
 //prac_syscall.c
 int				printk_str(char*);
 int				set_cpu_share(int);
+int				set_affinity(int, uint);
+int				set_deadline(int, int, int);
+int				group_create(int);
+int				group_join(int, int);
+int				group_destroy(int);
+int				set_gang(int);
+int				set_mlfq(struct mlfqparam*);
+int				get_mlfq(struct mlfqparam*);
+int				get_affinity(int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
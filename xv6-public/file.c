@@ -16,10 +16,88 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+struct {
+  struct spinlock lock;
+  struct files files[NPROC];
+} fstable;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&fstable.lock, "fstable");
+}
+
+// Allocate a files structure holding what old holds, or
+// only the root directory if old is 0. Used by fork().
+struct files*
+filescopy(struct files *old)
+{
+  struct files *fs;
+  int fd;
+
+  acquire(&fstable.lock);
+  for(fs = fstable.files; fs < fstable.files + NPROC; fs++)
+    if(fs->ref == 0)
+      goto found;
+  release(&fstable.lock);
+  return 0;
+
+found:
+  fs->ref = 1;
+  release(&fstable.lock);
+  initlock(&fs->lock, "files");
+  if(old == 0){
+    memset(fs->ofile, 0, sizeof(fs->ofile));
+    fs->cwd = namei("/");
+    return fs;
+  }
+  acquire(&old->lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    fs->ofile[fd] = old->ofile[fd] ? filedup(old->ofile[fd]) : 0;
+  fs->cwd = idup(old->cwd);
+  release(&old->lock);
+  return fs;
+}
+
+// Share fs with one more thread.
+struct files*
+filesdup(struct files *fs)
+{
+  acquire(&fstable.lock);
+  if(fs->ref < 1)
+    panic("filesdup");
+  fs->ref++;
+  release(&fstable.lock);
+  return fs;
+}
+
+// Drop a reference to fs; the last one closes its files.
+void
+filesput(struct files *fs)
+{
+  struct file *ofile[NOFILE];
+  struct inode *cwd;
+  int fd;
+
+  acquire(&fstable.lock);
+  if(fs->ref < 1)
+    panic("filesput");
+  if(--fs->ref > 0){
+    release(&fstable.lock);
+    return;
+  }
+  memmove(ofile, fs->ofile, sizeof(ofile));
+  cwd = fs->cwd;
+  fs->cwd = 0;
+  release(&fstable.lock);
+
+  for(fd = 0; fd < NOFILE; fd++)
+    if(ofile[fd])
+      fileclose(ofile[fd]);
+  begin_op();
+  iput(cwd);
+  end_op();
 }
 
 // Allocate a file structure.
@@ -8,6 +8,14 @@ struct file {
   uint off;
 };
 
+// Open files and current directory, shared by the LWPs of a process.
+struct files {
+  int ref;                     // reference count, protected by fstable.lock
+  struct spinlock lock;        // protects the fields below
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
 
 // in-memory copy of an inode
 struct inode {
@@ -0,0 +1,89 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futex_wait(addr, val) sleeps while the word at addr holds val,
+// and futex_wake(addr, n) wakes up to n of its sleepers. User
+// code keeps uncontended locks entirely in user space and only
+// calls in to block or to wake a blocked thread.
+//
+// A futex is keyed on the kernel address of the word, that is on
+// its physical address, so all threads sharing the page find the
+// same futex whatever the address they use. Waiters sleep on that
+// address. The check of the word and the sleep happen under the
+// futex's hash lock, which futex_wake() takes as well, so a wakeup
+// between the check and the sleep cannot be lost.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define NFUTEXHASH 16
+
+static struct spinlock futexlock[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futexlock[i], "futex");
+}
+
+// Kernel address of the aligned user word at addr, or 0.
+// An aligned word does not cross a page.
+static int*
+futexkey(uint addr)
+{
+  if(addr % sizeof(int) != 0)
+    return 0;
+  return (int*)uaddr(addr);
+}
+
+static struct spinlock*
+futexhash(int *key)
+{
+  return &futexlock[((uint)key >> 2) % NFUTEXHASH];
+}
+
+// Sleep until woken by futex_wake() if the word at addr holds val.
+// Returns 0 once woken, -1 if the word holds another value,
+// addr is bad, or the process was killed.
+int
+futex_wait(uint addr, int val)
+{
+  struct spinlock *lk;
+  int *key;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  lk = futexhash(key);
+  acquire(lk);
+  if(*key != val || myproc()->killed){
+    release(lk);
+    return -1;
+  }
+  sleep(key, lk);
+  release(lk);
+  return 0;
+}
+
+// Wake up to n threads sleeping on the word at addr.
+// Returns how many were woken, or -1 if addr is bad.
+int
+futex_wake(uint addr, int n)
+{
+  struct spinlock *lk;
+  int *key, woken;
+
+  if((key = futexkey(addr)) == 0 || n <= 0)
+    return key ? 0 : -1;
+  lk = futexhash(key);
+  acquire(lk);
+  woken = wakeupn(key, n);
+  release(lk);
+  return woken;
+}
@@ -0,0 +1,9 @@
+// mlfq parameters, see set_mlfq().
+
+struct mlfqparam {
+  int levels;              // Number of levels in use, at most NMLFQ
+  int quantum[NMLFQ];      // Time slice at each level, in ticks
+  int allotment[NMLFQ];    // Ticks run at a level before demotion
+  int boost;               // Ticks between boosts to the top level
+  int wakeboost;           // Levels a process rises when woken from I/O
+};
@@ -1,6 +1,11 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define NGROUP        8  // maximum number of scheduling groups
+#define NMLFQ         8  // maximum number of mlfq levels
+#define NSTACKIDLE    4  // joined thread stacks a process keeps mapped
+#define HZ          100  // ticks per second
+#define TICKUS  (1000000/HZ)  // microseconds per tick
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -4,14 +4,31 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "schedstat.h"
+#include "mlfq.h"
 
+// ptable.lock protects allocation of proc slots, the parent
+// links and the transition to ZOMBIE that wait() looks for.
+// Each process's own p->lock protects its state and is held
+// across the switch to and from scheduler().
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+// Sleeping processes, hashed by the channel they sleep on,
+// so that wakeup(chan) only visits the sleepers on chan.
+// A process is on the chain of its p->chan while p->chan is set;
+// both are protected by the chain's lock.
+#define NCHANHASH 64
+struct chanhash {
+  struct spinlock lock;
+  struct proc *head;
+} chantab[NCHANHASH];
+
 static struct proc *initproc;
 
 // pgdir lock for assign LWP
@@ -22,22 +39,57 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void schedtail(void);
+static struct proc* pclient(struct proc*);
+static void stackprune(struct proc*);
 
 // stride
-int mlfq_pass = 0;							// pass of mlfq
 int mlfq_stride = (int)(10000 / 100);		// stride of mlfq, intial CPU share value is 100
 int mlfq_share = 100;						// CPU share of mlfq
 
-// mlfq
-int totalticks = 0;							// for boosting
-int q_count[3] = {-1, -1, -1};				// the number of process in queue per level
-struct proc *q[3][NPROC];					// multi level queue
-int allotment[3] = {5, 10, 1000};			// allotment per queue
+// mlfq, tunable with set_mlfq()
+int mlfq_levels = 3;						// levels in use
+int quantum[NMLFQ] = {1, 2, 4};				// time slice per queue
+int allotment[NMLFQ] = {5, 10, 1000};		// allotment per queue
+int boost_period = 100;						// ticks between boostings
+int wake_boost = 1;							// levels risen on a wakeup from I/O
+static uint boostepoch;						// boostings so far on all cpus
+#define STRIDE_QUANTUM 1					// time slice of stride clients
+
+// Scheduling groups, protected by ptable.lock. Each group has a
+// share of the cpu like a stride client, and its processes share
+// that through an mlfq of their own. Group 0 is the default group,
+// with whatever share the stride clients and the other groups
+// leave over: mlfq_share.
+struct group {
+	int used;
+	int share;
+	int stride;
+	int nproc;	// Processes and LWPs in the group
+} groups[NGROUP];
+
+#define GROUPBIT(g) (1U << (g))
+#define gstride(g) ((g) ? groups[g].stride : mlfq_stride)
+
+// deadline
+#define DL_MAXBW 900						// per mille of a cpu for deadline tasks
+#define DL_MAXPERIOD 1000000				// longest period, in microseconds
 
 void
 pinit(void)
 {
+  struct proc *p;
+  struct cpu *c;
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  initlock(&pgdirlock, "pgdir");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    initlock(&p->lock, "proc");
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rqlock, "runqueue");
+  for(i = 0; i < NCHANHASH; i++)
+    initlock(&chantab[i].lock, "chanhash");
 }
 
 // Must be called with interrupts disabled
@@ -79,6 +131,1024 @@ myproc(void) {
   return p;
 }
 
+//PAGEBREAK: 30
+// Per-CPU run queues.
+// Each cpu owns an mlfq per scheduling group and a set of stride
+// clients, protected by its rqlock, so cpus scheduling unrelated
+// processes do not contend.
+// A process is on the run queue of cpus[p->cpu] while it is
+// RUNNABLE; scheduler() takes it off before running it.
+// Lock order: ptable.lock, a chantab chain lock, p->lock, rqlock.
+
+// Number of processes queued on or running on c.
+#define rqload(c) ((c)->nrunnable + ((c)->proc != 0))
+
+// Bit of cpus[i] in a cpu mask.
+#define CPUBIT(i) (1U << (i))
+
+// Pick the cpu in mask with the fewest runnable processes.
+// Racy, but only used as a placement hint.
+static int
+rqleast(uint mask)
+{
+	int i, best = -1;
+
+	for (i = 0; i < ncpu; i++)
+		if ((mask & CPUBIT(i)) &&
+		    (best < 0 || rqload(&cpus[i]) < rqload(&cpus[best])))
+			best = i;
+	return best < 0 ? 0 : best;
+}
+
+// Choose the cpu p should run on next. Soft affinity keeps p
+// on its last cpu, where its cache is warm, unless p may no
+// longer run there, or that cpu is busy while an allowed cpu
+// is idle or at least two processes less loaded.
+static int
+rqplace(struct proc *p)
+{
+	int best, load;
+
+	// Deadline tasks stay on the cpu that admitted them,
+	// stride threads go where their process is queued.
+	if (p->dl_runtime || pclient(p))
+		return p->cpu;
+	best = rqleast(p->cpumask);
+	if (!(p->cpumask & CPUBIT(p->cpu)))
+		return best;
+	load = rqload(&cpus[p->cpu]);
+	if (load > 0 &&
+	    (rqload(&cpus[best]) == 0 || rqload(&cpus[best]) + 1 < load))
+		return best;
+	return p->cpu;
+}
+
+// Wake a halted cpu to run what was just queued on c:
+// c itself if it is halted, otherwise any halted cpu
+// that can steal from c while c is busy.
+// Caller must have interrupts disabled.
+static void
+rqkick(struct cpu *c)
+{
+	struct cpu *i;
+
+	if (c->idle) {
+		if (c != mycpu())
+			lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+		return;
+	}
+	if (c->nrunnable < 2)
+		return;
+	for (i = cpus; i < &cpus[ncpu]; i++)
+		if (i->idle && i != mycpu()) {
+			lapicipi(i->apicid, T_IRQ0 + IRQ_RESCHED);
+			return;
+		}
+}
+
+// Halt c until an interrupt arrives. Its timer is stopped
+// (unless cpu 0 has timers to expire), so only new work wakes it.
+// rqkick() sends an IPI to a halted cpu after queueing work;
+// setting idle before the last look at the run queue, and
+// stihlt() being atomic, make sure that IPI is not lost.
+static void
+rqidle(struct cpu *c)
+{
+	cli();
+	c->sliceend = 0;
+	clockarm();
+	xchg(&c->idle, 1);
+	if (c->nrunnable == 0)
+		stihlt();
+	c->idle = 0;
+}
+
+// Stride scheduling is two-level. The stride client is a process:
+// its main thread holds the share, the pass and the heap position
+// for all of its threads, and the process is in the heap of its
+// cpu (gcpu) while any of its threads is queued. The queued threads
+// wait in a FIFO on the main thread (ghead), threaded through qnext
+// and qprev, and take turns, so the share of the process is split
+// among exactly its runnable threads.
+// The stride clients of a cpu form a binary min-heap on pass,
+// so selection, insertion and removal cost O(log n).
+// The mlfq of each scheduling group is a virtual client outside
+// the heap; there are only NGROUP of them, so they are compared
+// with the root one by one.
+// Caller must hold c->rqlock for all heap and group operations.
+
+// The main thread of the process p belongs to, which is also
+// the stride client of its threads.
+static struct proc*
+mainthread(struct proc *p)
+{
+	while (p->is_LWP)
+		p = p->parent;
+	return p;
+}
+
+// The stride client p is queued under, or 0 if p is not in the
+// stride class. A thread that holds a sleeplock a stride thread
+// waits for runs under the waiter's client, see pidonate().
+static struct proc*
+pclient(struct proc *p)
+{
+	if (p->dl_runtime)
+		return 0;
+	if (p->piclient)
+		return p->piclient;
+	return p->stride ? mainthread(p) : 0;
+}
+
+// The mlfq level p is queued at: its own, or a higher one
+// lent by a sleeplock waiter.
+static int
+qlevel(struct proc *p)
+{
+	if (p->pilock && p->pilevel < p->level)
+		return p->pilevel;
+	return p->level;
+}
+
+// Lock the cpu whose heap holds stride client g and return it.
+// The balancer may move g until we hold that rqlock.
+static struct cpu*
+glock(struct proc *g)
+{
+	struct cpu *c;
+
+	for (;;) {
+		c = &cpus[g->gcpu];
+		acquire(&c->rqlock);
+		if (c == &cpus[g->gcpu])
+			return c;
+		release(&c->rqlock);
+	}
+}
+
+// The cpus stride client g may be queued on: those that all of
+// its threads may run on. Caller must hold ptable.lock.
+static uint
+gmaskof(struct proc *g)
+{
+	struct proc *p;
+	uint mask = g->cpumask;
+
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if (p->is_LWP && p->state != UNUSED && mainthread(p) == g)
+			mask &= p->cpumask;
+	return mask;
+}
+
+static int rqmove(struct cpu*, struct cpu*, struct proc*);
+static void rqlock2(struct cpu*, struct cpu*);
+
+// Move stride client g, with its queued threads, to a cpu in
+// g->gmask if it is on one outside it.
+// Caller must hold ptable.lock.
+static void
+gmove(struct proc *g)
+{
+	struct cpu *b, *c;
+
+	for (;;) {
+		b = &cpus[g->gcpu];
+		if (g->gmask & CPUBIT(b - cpus))
+			return;
+		c = &cpus[rqleast(g->gmask)];
+		rqlock2(b, c);
+		if (b == &cpus[g->gcpu])
+			break;
+		release(&c->rqlock);
+		release(&b->rqlock);
+	}
+	if (g->hidx >= 0)
+		rqmove(b, c, g);
+	else
+		g->gcpu = c - cpus;
+	release(&c->rqlock);
+	release(&b->rqlock);
+	rqkick(c);
+}
+
+static void
+gpush(struct proc *g, struct proc *p)
+{
+	p->qnext = 0;
+	p->qprev = g->gtail;
+	if (g->gtail)
+		g->gtail->qnext = p;
+	else
+		g->ghead = p;
+	g->gtail = p;
+}
+
+static void
+gremove(struct proc *g, struct proc *p)
+{
+	if (p->qprev)
+		p->qprev->qnext = p->qnext;
+	else
+		g->ghead = p->qnext;
+	if (p->qnext)
+		p->qnext->qprev = p->qprev;
+	else
+		g->gtail = p->qprev;
+	p->qprev = p->qnext = 0;
+}
+
+static void
+heapset(struct cpu *c, int i, struct proc *p)
+{
+	c->sheap[i] = p;
+	p->hidx = i;
+}
+
+// Move the entry at i up until its parent has a smaller pass.
+static void
+heapup(struct cpu *c, int i)
+{
+	struct proc *p = c->sheap[i];
+
+	while (i > 0 && p->pass < c->sheap[(i - 1) / 2]->pass) {
+		heapset(c, i, c->sheap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	heapset(c, i, p);
+}
+
+// Move the entry at i down until its children have larger passes.
+static void
+heapdown(struct cpu *c, int i)
+{
+	struct proc *p = c->sheap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < c->nsheap) {
+		if (child + 1 < c->nsheap &&
+				c->sheap[child + 1]->pass < c->sheap[child]->pass)
+			child++;
+		if (p->pass <= c->sheap[child]->pass)
+			break;
+		heapset(c, i, c->sheap[child]);
+		i = child;
+	}
+	heapset(c, i, p);
+}
+
+static void
+heappush(struct cpu *c, struct proc *p)
+{
+	heapset(c, c->nsheap++, p);
+	heapup(c, p->hidx);
+}
+
+// Remove the entry at i from the heap.
+static void
+heapdel(struct cpu *c, int i)
+{
+	struct proc *p = c->sheap[i];
+
+	p->hidx = -1;
+	if (i == --c->nsheap)
+		return;
+	heapset(c, i, c->sheap[c->nsheap]);
+	heapdown(c, i);
+	heapup(c, i);
+}
+
+// Minimum pass among the stride clients of c and the mlfqs
+// of the default group and of the groups queued on c.
+// Caller must hold c->rqlock.
+static int
+rqminpass(struct cpu *c)
+{
+	int g, min = c->grq[0].pass;
+
+	if (c->nsheap > 0 && c->sheap[0]->pass < min)
+		min = c->sheap[0]->pass;
+	for (g = 1; g < NGROUP; g++)
+		if ((c->gactive & GROUPBIT(g)) && c->grq[g].pass < min)
+			min = c->grq[g].pass;
+	return min;
+}
+
+// Each mlfq level is a doubly linked list threaded through
+// struct proc, so enqueue, dequeue and demotion are O(1).
+// Caller must hold c->rqlock for all list operations.
+
+// Append p to the tail of the level, or push it at the head.
+static void
+qpush(struct grq *q, int level, struct proc *p, int front)
+{
+	p->qprev = p->qnext = 0;
+	if (q->qhead[level] == 0) {
+		q->qhead[level] = q->qtail[level] = p;
+	} else if (front) {
+		p->qnext = q->qhead[level];
+		q->qhead[level]->qprev = p;
+		q->qhead[level] = p;
+	} else {
+		p->qprev = q->qtail[level];
+		q->qtail[level]->qnext = p;
+		q->qtail[level] = p;
+	}
+}
+
+static void
+qremove(struct grq *q, int level, struct proc *p)
+{
+	if (p->qprev)
+		p->qprev->qnext = p->qnext;
+	else
+		q->qhead[level] = p->qnext;
+	if (p->qnext)
+		p->qnext->qprev = p->qprev;
+	else
+		q->qtail[level] = p->qprev;
+	p->qprev = p->qnext = 0;
+}
+
+// Boosting splices the lower levels onto the tail of level 0
+// without visiting the processes, and stamps c->boosts with a
+// new boostepoch. A process whose p->boosts is behind that of
+// its cpu has been boosted since it was last synced: either it
+// was queued and spliced, or it was asleep or running elsewhere
+// and missed the boost. Lift it to level 0 before using its
+// level, and before queueing it. The epoch is global, so the
+// comparison holds after p moves to another cpu.
+static void
+rqsync(struct cpu *c, struct proc *p)
+{
+	if ((int)(c->boosts - p->boosts) <= 0)
+		return;
+	p->boosts = boostepoch;
+	if (p->level != 0) {
+		p->nboost++;
+		p->level = 0;
+		p->ticks = 0;
+		p->tickus = 0;
+	}
+}
+
+// Move every process of a lower level to level 0, in every group.
+// Caller must hold c->rqlock.
+static void
+rqboost(struct cpu *c)
+{
+	struct grq *q;
+	int level;
+
+	for (q = c->grq; q < &c->grq[NGROUP]; q++) {
+		for (level = 1; level < NMLFQ; level++) {
+			if (q->qhead[level] == 0)
+				continue;
+			if (q->qhead[0] == 0) {
+				q->qhead[0] = q->qhead[level];
+			} else {
+				q->qtail[0]->qnext = q->qhead[level];
+				q->qhead[level]->qprev = q->qtail[0];
+			}
+			q->qtail[0] = q->qtail[level];
+			q->qhead[level] = q->qtail[level] = 0;
+		}
+	}
+	c->boosts = __sync_add_and_fetch(&boostepoch, 1);
+	c->lastboost = ticks;
+}
+
+// Queue mlfq process p on the mlfq of its group on c, at the
+// front or the back of its level. A group that had nothing
+// queued on c catches up with the minimum pass, so that it can
+// neither save up turns nor wait for the others to catch up.
+static void
+grqpush(struct cpu *c, struct proc *p, int front)
+{
+	struct grq *q = &c->grq[p->group];
+	int minpass;
+
+	// set_mlfq() may have taken away the level of p.
+	if (p->level >= mlfq_levels) {
+		p->level = mlfq_levels - 1;
+		p->ticks = 0;
+		p->tickus = 0;
+	}
+	if (p->group != 0 && q->nqueued == 0) {
+		minpass = rqminpass(c);
+		if (q->pass < minpass)
+			q->pass = minpass;
+		c->gactive |= GROUPBIT(p->group);
+	}
+	qpush(q, qlevel(p), p, front);
+	q->nqueued++;
+}
+
+static void
+grqremove(struct cpu *c, struct proc *p)
+{
+	struct grq *q = &c->grq[p->group];
+
+	rqsync(c, p);
+	qremove(q, qlevel(p), p);
+	if (--q->nqueued == 0)
+		c->gactive &= ~GROUPBIT(p->group);
+}
+
+// Deadline tasks are scheduled earliest deadline first, ahead of
+// the stride clients and the mlfq. Each cpu keeps its runnable
+// deadline tasks in a list sorted on dl_abs, threaded through qnext
+// and qprev like an mlfq level. A task that overruns its budget is
+// throttled, and not counted in nrunnable, until its budget is
+// replenished at the start of its next period. It waits on a
+// second list sorted on dl_ready, so that picking a task never
+// has to look at the throttled ones.
+// Caller must hold c->rqlock for all deadline list operations.
+
+// Insert p in the list for its dl_throttled.
+static void
+dlinsert(struct cpu *c, struct proc *p)
+{
+	struct proc **pp, *prev = 0;
+
+	if (p->dl_throttled)
+		for (pp = &c->dlthrottled; *pp && (*pp)->dl_ready <= p->dl_ready;
+		     pp = &(*pp)->qnext)
+			prev = *pp;
+	else
+		for (pp = &c->dlhead; *pp && (*pp)->dl_abs <= p->dl_abs;
+		     pp = &(*pp)->qnext)
+			prev = *pp;
+	p->qprev = prev;
+	p->qnext = *pp;
+	if (*pp)
+		(*pp)->qprev = p;
+	*pp = p;
+}
+
+static void
+dlremove(struct cpu *c, struct proc *p)
+{
+	if (p->qprev)
+		p->qprev->qnext = p->qnext;
+	else if (p->dl_throttled)
+		c->dlthrottled = p->qnext;
+	else
+		c->dlhead = p->qnext;
+	if (p->qnext)
+		p->qnext->qprev = p->qprev;
+	p->qprev = p->qnext = 0;
+}
+
+// Apply the constant bandwidth server rules to deadline task p
+// about to be queued. Returns 0 if p has overrun its budget and
+// is throttled until its next period.
+static int
+dlrefresh(struct proc *p, int woken)
+{
+	uint64 now = clocknow();
+
+	// A task waking up starts a new job, unless what is left of
+	// its budget fits in its bandwidth until the current deadline.
+	if (woken && (now >= p->dl_abs || (p->dl_budget > 0 &&
+	    (uint64)p->dl_budget * p->dl_period > (p->dl_abs - now) * p->dl_runtime))) {
+		p->dl_abs = now + p->dl_deadline;
+		p->dl_budget = p->dl_runtime;
+	}
+	// An overrun budget is replenished at the next period.
+	while (p->dl_budget <= 0) {
+		p->dl_ready = p->dl_abs - p->dl_deadline + p->dl_period;
+		p->dl_abs += p->dl_period;
+		p->dl_budget += p->dl_runtime;
+	}
+	p->dl_throttled = (p->dl_ready > now);
+	return !p->dl_throttled;
+}
+
+// Take the runnable deadline task with the earliest deadline off
+// the lists of c, or return 0. Throttled tasks whose period has
+// come are unthrottled first, and c->dlwake is set to when the
+// next one is.
+static struct proc*
+dlpick(struct cpu *c)
+{
+	struct proc *p;
+	uint64 now;
+
+	c->dlwake = 0;
+	if (c->dlthrottled) {
+		now = clocknow();
+		while ((p = c->dlthrottled) != 0 && p->dl_ready <= now) {
+			dlremove(c, p);
+			p->dl_throttled = 0;
+			dlinsert(c, p);
+			c->nrunnable++;
+		}
+		if (p)
+			c->dlwake = p->dl_ready;
+	}
+	if ((p = c->dlhead) != 0)
+		dlremove(c, p);
+	return p;
+}
+
+// Make c give up its cpu if deadline task p, just queued on it,
+// should run before what c is running. rqpick() clears c->preempt.
+// Caller must hold c->rqlock.
+static void
+dlpreempt(struct cpu *c, struct proc *p)
+{
+	struct proc *cur = c->proc;
+
+	if (cur == p || (cur && cur->dl_runtime && cur->dl_abs <= p->dl_abs))
+		return;
+	c->preempt = 1;
+	if (cur)
+		lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+// Put p on the run queue of its cpu, or of an allowed cpu
+// if its mask has changed since it was placed. A stride thread
+// goes to the cpu of its process.
+// An mlfq process first catches up with the boosts of the cpu
+// (see rqsync), then goes on its level, at the front if it was
+// woken; wakeproc() has already lifted it by wake_boost if a
+// device woke it. A stride client woken after it had nothing
+// queued catches up with the minimum pass.
+// Caller must hold p->lock and p must be RUNNABLE.
+static void
+rqadd(struct proc *p, int woken)
+{
+	struct cpu *c;
+	struct proc *g;
+	int ready, minpass;
+
+	if (p->readyat == 0)
+		p->readyat = clocknow();
+	// A lent client may be queued where p may not run; then p
+	// keeps only a loan of mlfq level 0, see pidonate().
+	if (p->piclient && (p->piclient->gmask & ~p->cpumask)) {
+		p->piclient = 0;
+		p->pilevel = 0;
+	}
+	if ((g = pclient(p)) != 0) {
+		c = glock(g);
+		if (g->ghead == 0 && !(g->gmask & CPUBIT(g->gcpu))) {
+			// Nothing queued: the process can move freely.
+			g->gcpu = rqleast(g->gmask);
+			release(&c->rqlock);
+			c = glock(g);
+		}
+		p->cpu = c - cpus;
+		if (g->ghead == 0) {
+			minpass = rqminpass(c);
+			if (woken && g->pass < minpass)
+				g->pass = minpass;
+			heappush(c, g);
+		}
+		gpush(g, p);
+		c->nrunnable++;
+		p->queued = 1;
+		release(&c->rqlock);
+		rqkick(c);
+		return;
+	}
+
+	if (!(p->cpumask & CPUBIT(p->cpu)))
+		p->cpu = rqleast(p->cpumask);
+	c = &cpus[p->cpu];
+	acquire(&c->rqlock);
+	if (p->dl_runtime) {
+		ready = dlrefresh(p, woken);
+		dlinsert(c, p);
+		if (ready) {
+			c->nrunnable++;
+			dlpreempt(c, p);
+		}
+	} else {
+		rqsync(c, p);
+		grqpush(c, p, woken);
+		c->nrunnable++;
+	}
+	p->queued = 1;
+	release(&c->rqlock);
+	rqkick(c);
+}
+
+// Take p off the run queue of its cpu.
+// Returns 1 if p was queued, 0 if not
+// (e.g. a cpu has already picked it).
+// Caller must hold p->lock.
+static int
+rqdel(struct proc *p)
+{
+	struct cpu *c;
+	struct proc *g;
+
+	// The balancer may move p to another cpu until we
+	// hold the rqlock of the cpu it is queued on.
+	for (;;) {
+		c = &cpus[p->cpu];
+		acquire(&c->rqlock);
+		if (c == &cpus[p->cpu])
+			break;
+		release(&c->rqlock);
+	}
+	if (!p->queued) {
+		release(&c->rqlock);
+		return 0;
+	}
+	if (c->gang == p) {
+		c->gang = 0;
+		c->nrunnable--;
+	} else if (p->dl_runtime) {
+		dlremove(c, p);
+		if (!p->dl_throttled)
+			c->nrunnable--;
+		p->dl_throttled = 0;
+	} else if ((g = pclient(p)) == 0) {
+		grqremove(c, p);
+		c->nrunnable--;
+	} else {
+		gremove(g, p);
+		if (g->ghead == 0)
+			heapdel(c, g->hidx);
+		c->nrunnable--;
+	}
+	p->queued = 0;
+	release(&c->rqlock);
+	return 1;
+}
+
+// Choose the next process to run on c and take it off the run queue.
+// Deadline tasks come first, then a gang thread sent by another
+// cpu (see gangsend()). After them, the mlfq of each group
+// queued on c competes with the stride clients as one client;
+// inside an mlfq the highest non-empty level runs first.
+// Returns 0 if nothing is runnable on c.
+static struct proc*
+rqpick(struct cpu *c)
+{
+	struct proc *p, *g;
+	struct grq *q;
+	int level, i, best;
+
+	acquire(&c->rqlock);
+	c->preempt = 0;
+	if ((p = dlpick(c)) != 0)
+		goto found;
+	if ((p = c->gang) != 0) {
+		c->gang = 0;
+		goto found;
+	}
+	for (;;) {
+		if (c->nrunnable == 0) {
+			release(&c->rqlock);
+			return 0;
+		}
+
+		// the mlfq with the minimum pass; the default one
+		// takes its turns even when it is empty
+		best = 0;
+		for (i = 1; i < NGROUP; i++)
+			if ((c->gactive & GROUPBIT(i)) &&
+			    c->grq[i].pass < c->grq[best].pass)
+				best = i;
+		q = &c->grq[best];
+
+		// if not mlfq is minimum pass
+		if (c->nsheap > 0 && c->sheap[0]->pass <= q->pass) {
+			g = c->sheap[0];
+			p = g->ghead;
+			gremove(g, p);
+			g->pass += g->stride;
+			if (g->ghead)
+				heapdown(c, 0);
+			else
+				heapdel(c, 0);
+			break;
+		}
+
+		// if mlfq is minimum pass
+		q->pass += gstride(best);
+
+		// boosting!!!!
+		if (ticks - c->lastboost >= boost_period)
+			rqboost(c);
+
+		for (level = 0; level < mlfq_levels; level++)
+			if (q->qhead[level])
+				break;
+		// mlfq is empty, give the turn to the stride clients
+		if (level == mlfq_levels)
+			continue;
+
+		p = q->qhead[level];
+		grqremove(c, p);
+		break;
+	}
+found:
+	p->queued = 0;
+	c->nrunnable--;
+	release(&c->rqlock);
+	return p;
+}
+
+// Advance the pass of the client p runs under on c for one
+// dispatch, as rqpick() does, when p is run without it.
+// Caller must hold c->rqlock.
+static void
+rqcharge(struct cpu *c, struct proc *p)
+{
+	struct proc *g;
+
+	if (p->dl_runtime)
+		return;
+	if ((g = pclient(p)) == 0) {
+		c->grq[p->group].pass += gstride(p->group);
+		return;
+	}
+	// A gang thread's client is on the heap of another cpu.
+	if (g->gcpu != c - cpus)
+		return;
+	g->pass += g->stride;
+	if (g->hidx >= 0)
+		heapdown(c, g->hidx);
+}
+
+//PAGEBREAK: 30
+// Load balancing.
+// A cpu pulls RUNNABLE processes from the most loaded cpu when it
+// runs out of work, and every BALANCE_PERIOD ticks while busy.
+#define BALANCE_PERIOD 10
+
+// Choose a queued mlfq process or a stride client of b to give
+// away to c, or 0. Prefer the lowest mlfq level, whose processes
+// are the least sensitive to losing their cache. A process that
+// is still switching out on b (b->proc), or may not run on c,
+// is left alone, and so is the stride client it belongs to.
+// Caller must hold b->rqlock.
+static struct proc*
+rqvictim(struct cpu *b, struct cpu *c)
+{
+	struct proc *p, *g;
+	struct grq *q;
+	uint bit = CPUBIT(c - cpus);
+	int level, i;
+
+	for (level = mlfq_levels - 1; level >= 0; level--)
+		for (q = b->grq; q < &b->grq[NGROUP]; q++)
+			for (p = q->qtail[level]; p; p = p->qprev)
+				if (p != b->proc && (p->cpumask & bit))
+					return p;
+	p = b->proc;
+	for (i = b->nsheap - 1; i >= 0; i--) {
+		g = b->sheap[i];
+		if ((g->gmask & bit) &&
+		    !(p && p->queued && pclient(p) == g))
+			return g;
+	}
+	return 0;
+}
+
+// Move queued mlfq process p, or stride client p with all its
+// queued threads, from the run queue of b to that of c.
+// An mlfq process keeps its level and ticks, a stride client's
+// pass keeps the same distance from the minimum pass of the cpu.
+// Returns the number of threads moved.
+// Caller must hold both rqlocks.
+static int
+rqmove(struct cpu *b, struct cpu *c, struct proc *p)
+{
+	struct proc *t;
+	int lag, n;
+
+	if (p->stride == 0) {
+		grqremove(b, p);
+		rqsync(c, p);
+		grqpush(c, p, 0);
+		p->cpu = c - cpus;
+		n = 1;
+	} else {
+		lag = p->pass - rqminpass(b);
+		heapdel(b, p->hidx);
+		p->pass = rqminpass(c) + lag;
+		heappush(c, p);
+		p->gcpu = c - cpus;
+		n = 0;
+		for (t = p->ghead; t; t = t->qnext) {
+			t->cpu = c - cpus;
+			n++;
+		}
+	}
+	b->nrunnable -= n;
+	c->nrunnable += n;
+	return n;
+}
+
+// Take the rqlocks of a and b in cpu order to avoid deadlock.
+static void
+rqlock2(struct cpu *a, struct cpu *b)
+{
+	if (a < b) {
+		acquire(&a->rqlock);
+		acquire(&b->rqlock);
+	} else {
+		acquire(&b->rqlock);
+		acquire(&a->rqlock);
+	}
+}
+
+// Pull processes from the busiest cpu to c until both have
+// about the same number queued. An idle c takes work as soon
+// as anything is waiting elsewhere.
+static void
+rqbalance(struct cpu *c)
+{
+	struct cpu *b, *busiest = 0;
+	struct proc *p;
+	int n;
+
+	for (b = cpus; b < &cpus[ncpu]; b++)
+		if (b != c && (busiest == 0 || b->nrunnable > busiest->nrunnable))
+			busiest = b;
+	if (busiest == 0 || busiest->nrunnable <= c->nrunnable)
+		return;
+
+	rqlock2(busiest, c);
+	n = (busiest->nrunnable - c->nrunnable + (c->proc == 0)) / 2;
+	while (n > 0 && (p = rqvictim(busiest, c)) != 0)
+		n -= rqmove(busiest, c, p);
+	release(&busiest->rqlock);
+	release(&c->rqlock);
+}
+
+// Called on every timer interrupt of every cpu.
+void
+balancetick(void)
+{
+	struct cpu *c = mycpu();
+
+	if (ticks - c->lastbalance < BALANCE_PERIOD)
+		return;
+	c->lastbalance = ticks;
+	rqbalance(c);
+}
+
+//PAGEBREAK: 30
+// Gang scheduling.
+// The threads of a stride process in gang mode should run at
+// the same time, so that they do not wait at their barriers for
+// a sibling that is not running. When a cpu picks a thread of
+// such a process, it sends the other queued threads to the
+// other allowed cpus, one each, and makes those cpus reschedule.
+// A sent thread waits in c->gang, which rqpick() serves ahead of
+// everything but deadline tasks. Each sent thread advances the
+// pass of its process as if it had been picked in turn, so a gang
+// still gets its share, only in fewer, wider slices.
+
+// Send queued threads of gang g, queued on c, to other cpus.
+static void
+gangsend(struct cpu *c, struct proc *g)
+{
+	struct cpu *i;
+	struct proc *t;
+
+	// Only the cpu the gang is queued on sends.
+	if (g->gcpu != c - cpus)
+		return;
+	for (i = cpus; i < &cpus[ncpu] && g->ghead; i++) {
+		if (i == c || i->gang || i->dlhead)
+			continue;
+		rqlock2(c, i);
+		if (g->gcpu == c - cpus && (t = g->ghead) != 0 &&
+		    (t->cpumask & CPUBIT(i - cpus)) &&
+		    i->gang == 0 && i->dlhead == 0) {
+			gremove(g, t);
+			g->pass += g->stride;
+			if (g->ghead)
+				heapdown(c, g->hidx);
+			else
+				heapdel(c, g->hidx);
+			c->nrunnable--;
+			t->cpu = i - cpus;
+			i->gang = t;
+			i->nrunnable++;
+			i->preempt = 1;
+			// lapicipi() needs interrupts off, as they are
+			// while we hold the rqlocks.
+			lapicipi(i->apicid, T_IRQ0 + IRQ_RESCHED);
+		}
+		release(&i->rqlock);
+		release(&c->rqlock);
+	}
+}
+
+// Put the process of the caller in gang mode, or take it
+// out. It takes effect while the process has a cpu share.
+int
+set_gang(int on)
+{
+	struct proc *g;
+
+	acquire(&ptable.lock);
+	g = mainthread(myproc());
+	g->gang = (on != 0);
+	release(&ptable.lock);
+	return 0;
+}
+
+// Priority inheritance for sleeplocks.
+// A process about to wait for a sleeplock lends its priority to
+// the holder if that outranks the holder's own: a stride waiter
+// makes the holder run under its stride client, whose share the
+// waiter cannot use while it waits, if the holder is in the mlfq
+// or has a smaller share, and an mlfq waiter lends its level. A deadline waiter lends mlfq level 0, and so does a stride
+// waiter whose client may be queued on a cpu the holder may not
+// use (see rqadd()). The loan is returned
+// when the holder releases the lock. A holder keeps one loan at a
+// time, for the lock it was lent for; later loans for the same or
+// other locks replace it if they rank higher.
+
+// Rank of p's scheduling class, lower runs first: deadline
+// tasks, then stride clients by share, larger first (a stride
+// is at most 10000), then the mlfq by level.
+static int
+pirank(struct proc *p)
+{
+	struct proc *g;
+
+	if (p->dl_runtime)
+		return 0;
+	if ((g = pclient(p)) != 0)
+		return 1 + g->stride;
+	return 1 + 10000 + 1 + qlevel(p);
+}
+
+// Set the loan of p, requeueing p if it is queued so that
+// the loan takes effect at once. Caller must hold p->lock.
+static void
+pirequeue(struct proc *p, struct proc *client, int level, void *lk)
+{
+	int queued;
+
+	queued = (p->state == RUNNABLE && rqdel(p));
+	p->piclient = client;
+	p->pilevel = level;
+	p->pilock = lk;
+	if (queued)
+		rqadd(p, 0);
+}
+
+// The caller is about to wait for sleeplock lk held by h.
+// Caller must hold the spinlock of lk.
+void
+pidonate(struct proc *h, void *lk)
+{
+	struct proc *p = myproc();
+
+	if (h == 0 || h == p)
+		return;
+	acquire(&h->lock);
+	if (h->state != UNUSED && h->state != ZOMBIE && pirank(p) < pirank(h)) {
+		if (p->dl_runtime)
+			pirequeue(h, 0, 0, lk);
+		else
+			pirequeue(h, pclient(p), qlevel(p), lk);
+	}
+	release(&h->lock);
+}
+
+// h released sleeplock lk: return the loan it got for lk.
+// Caller must hold the spinlock of lk.
+void
+piundo(struct proc *h, void *lk)
+{
+	acquire(&h->lock);
+	if (h->pilock == lk)
+		pirequeue(h, 0, 0, 0);
+	release(&h->lock);
+}
+
+// Make sleeping p runnable again. p keeps its mlfq level and the
+// ticks it has run there, so sleeping just before its allotment
+// runs out does not save it from demotion, but a process woken
+// by a device (io, see wakeupio) rises wake_boost levels.
+// Caller must hold p->lock.
+static void
+wakeproc(struct proc *p, int io)
+{
+	if (io && wake_boost > 0 && p->level > 0) {
+		p->level = p->level > wake_boost ? p->level - wake_boost : 0;
+		p->ticks = 0;
+		p->tickus = 0;
+	}
+	p->state = RUNNABLE;
+	// Nothing has run p since it slept, so it may move to
+	// an idle cpu instead of queueing behind busy ones.
+	p->cpu = rqplace(p);
+	rqadd(p, 1);
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -104,14 +1174,32 @@ found:
   p->pid = nextpid++;
   // initailze for mlfq and stide scheduling
   // At first, all processes enter to queue of level 0
+  // of the least loaded cpu
+  p->cpumask = CPUBIT(ncpu) - 1;
+  p->gmask = p->cpumask;
+  p->cpu = rqleast(p->cpumask);
+  p->group = 0;
   p->level = 0;
   p->ticks = 0;
+  p->tickus = 0;
   p->cpu_share = 0;
   p->stride = 0;
   p->pass = 0;
-  q_count[0]++;
-  q[0][q_count[0]] = p;
-
+  p->hidx = -1;
+  p->queued = 0;
+  p->dl_runtime = 0;
+  p->dl_throttled = 0;
+  p->handoff = 0;
+  p->pilock = 0;
+  p->piclient = 0;
+  p->gang = 0;
+  p->runtime = 0;
+  p->waittime = 0;
+  p->readyat = 0;
+  p->nvcsw = 0;
+  p->nivcsw = 0;
+  p->ndemote = 0;
+  p->nboost = 0;
 
   // Set LWP options
   p->is_LWP = 0;	// is process
@@ -119,6 +1207,9 @@ found:
   p->all_LWP = 0;
   p->tid = -1;
   p->wtid = -1;
+  memset(p->lwp, 0, sizeof(p->lwp));
+  p->ustack = 0;
+  p->nstackpool = 0;
 
   release(&ptable.lock);
 
@@ -146,6 +1237,44 @@ found:
   return p;
 }
 
+// Release the kernel stack and scheduling state of p
+// and return its slot to the table. Does not free the page
+// table, which LWPs share with their main thread.
+// Caller must hold ptable.lock and p->lock.
+static void
+freeproc(struct proc *p)
+{
+	kfree(p->kstack);
+	p->kstack = 0;
+	p->pid = 0;
+	p->parent = 0;
+	p->name[0] = 0;
+	p->killed = 0;
+	// initailize variables for sceduling
+	p->level = 0;
+	p->ticks = 0;
+	if (p->group)
+		groups[p->group].nproc--;
+	p->group = 0;
+	mlfq_share += p->cpu_share;
+	mlfq_stride = (int) (10000 / mlfq_share);
+	p->cpu_share = 0;
+	p->stride = 0;
+	p->pass = 0;
+	if (p->dl_runtime) {
+		cpus[p->cpu].dlbw -= p->dl_bw;
+		p->dl_runtime = 0;
+	}
+	// initialize variables for LWP
+	p->is_LWP = 0;
+	p->num_LWP = 0;
+	p->all_LWP = 0;
+	p->tid = -1;
+	p->wtid = -1;
+
+	p->state = UNUSED;
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -155,7 +1284,7 @@ userinit(void)
   extern char _binary_initcode_start[], _binary_initcode_size[];
 
   p = allocproc();
-  
+
   initproc = p;
   if((p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
@@ -171,666 +1300,748 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  if((p->files = filescopy(0)) == 0)
+    panic("userinit: out of files");
 
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
   p->state = RUNNABLE;
+  rqadd(p, 0);
 
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
+// Threads share the memory, and the size, of their main thread;
+// pgdirlock keeps it consistent with thread_create() and uaddr().
 int
 growproc(int n)
 {
   uint sz;
   struct proc *curproc = myproc();
+  struct proc *mp = mainthread(curproc);
 
-  if (curproc->is_LWP) {
-	  sz = curproc->parent->sz;
-	  if(n > 0){
-		  if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-			  return -1;
-	  } else if(n < 0){
-		  if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-			  return -1;
-	  }
-	  curproc->parent->sz = sz;
-  } else {
-	  sz = curproc->sz;
-	  if(n > 0){
-		  if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-			  return -1;
-	  } else if(n < 0){
-		  if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-			  return -1;
-	  }
-	  curproc->sz = sz;
+  acquire(&pgdirlock);
+  sz = mp->sz;
+  if(n > 0){
+    if((sz = allocuvm(mp->pgdir, sz, sz + n)) == 0){
+      release(&pgdirlock);
+      return -1;
+    }
+  } else if(n < 0){
+    if((sz = deallocuvm(mp->pgdir, sz, sz + n)) == 0){
+      release(&pgdirlock);
+      return -1;
+    }
   }
+  mp->sz = sz;
+  if(n < 0)
+    stackprune(mp);
+  release(&pgdirlock);
 
   switchuvm(curproc);
   return 0;
 }
 
+// Kernel address of the byte at user address addr in the
+// current process, or 0 if it is not mapped. Threads look at
+// the size of their main thread; their own copy may be stale.
+char*
+uaddr(uint addr)
+{
+  struct proc *mp = mainthread(myproc());
+  char *page = 0;
+
+  acquire(&pgdirlock);
+  if(addr < mp->sz)
+    page = uva2ka(mp->pgdir, (char*)PGROUNDDOWN(addr));
+  release(&pgdirlock);
+  return page ? page + (addr - PGROUNDDOWN(addr)) : 0;
+}
+
+// Are the n bytes at user address addr mapped in the current
+// process? This runs for every system call argument, so it does
+// not take pgdirlock: page tables are not freed while the process
+// lives, and checking before use races with the other threads
+// anyway. Only the unmapped stacks of the pool leave holes below
+// sz; without them the size is enough.
+int
+uvalid(uint addr, uint n)
+{
+  struct proc *mp = mainthread(myproc());
+  uint a;
+
+  if(addr >= mp->sz || n > mp->sz - addr)
+    return 0;
+  if(mp->nstackpool == 0)
+    return 1;
+  for(a = PGROUNDDOWN(addr); a < addr + n; a += PGSIZE)
+    if(uva2ka(mp->pgdir, (char*)a) == 0)
+      return 0;
+  return 1;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *curproc = myproc();
+  struct proc *mp = mainthread(curproc);
 
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
   }
 
-  // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  // Copy process state from proc. The memory is that of the
+  // main thread, and with it the pool of stacks, whose unmapped
+  // entries are the holes copyuvm() skips.
+  acquire(&pgdirlock);
+  if((np->pgdir = copyuvm(mp->pgdir, mp->sz)) == 0){
+    release(&pgdirlock);
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
-  np->sz = curproc->sz;
+  np->sz = mp->sz;
+  memmove(np->stackpool, mp->stackpool, sizeof(np->stackpool));
+  np->nstackpool = mp->nstackpool;
+  release(&pgdirlock);
   np->parent = curproc;
+  np->cpumask = curproc->cpumask;
+  np->gmask = np->cpumask;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+  if((np->files = filescopy(curproc->files)) == 0){
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
+  // The child runs in the scheduling group of its parent.
   acquire(&ptable.lock);
+  np->group = curproc->group;
+  if(np->group)
+    groups[np->group].nproc++;
+  release(&ptable.lock);
+
+  acquire(&np->lock);
 
   np->state = RUNNABLE;
+  rqadd(np, 0);
 
-  release(&ptable.lock);
+  release(&np->lock);
   //cprintf("fork : %d\n", pid);
 
   return pid;
 }
 
+// Mark p killed and wake it if it sleeps,
+// so that it exits on its way back to user space.
+static void
+killproc(struct proc *p)
+{
+	acquire(&p->lock);
+	p->killed = 1;
+	// Wake process from sleep if necessary.
+	if (p->state == SLEEPING)
+		wakeproc(p, 0);
+	release(&p->lock);
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// Exit from any thread terminates the whole process:
+// an LWP passes the exit on to its main thread, which
+// reaps all of its LWPs before it becomes a zombie.
 void
 exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
-  int i, j, level;
+  int tid, alive;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // if curproc is process and has no thread
-  if (!curproc->is_LWP && !curproc->num_LWP) {
-	  for(fd = 0; fd < NOFILE; fd++){
-		  if(curproc->ofile[fd]){
-			  fileclose(curproc->ofile[fd]);
-			  curproc->ofile[fd] = 0;
+  // if curproc is LWP, main thread will clean up the process
+  if (curproc->is_LWP) {
+	  killproc(curproc->parent);
+	  thread_exit(0);
+  }
+
+  // if curproc is process and has some threads,
+  // kill them and wait until all of them stop running.
+  // A thread may be running on another cpu, so its
+  // kernel stack can be freed only after it is a zombie.
+  // Being killed keeps thread_create() from adding more.
+  acquire(&ptable.lock);
+  curproc->killed = 1;
+  if (curproc->num_LWP) {
+	  for(tid = 0; tid < NPROC; tid++)
+		  if ((p = curproc->lwp[tid]) != 0)
+			  killproc(p);
+	  for(;;){
+		  alive = -1;
+		  for(tid = 0; tid < NPROC; tid++){
+			  if ((p = curproc->lwp[tid]) == 0)
+				  continue;
+			  acquire(&p->lock);
+			  if (p->state == ZOMBIE){
+				  freeproc(p);
+				  curproc->lwp[tid] = 0;
+				  curproc->num_LWP--;
+			  } else
+				  alive = tid;
+			  release(&p->lock);
 		  }
+		  if (alive < 0)
+			  break;
+		  // Threads wake their joiner in thread_exit().
+		  sleep(&curproc->lwp[alive], &ptable.lock);
 	  }
+  }
+  release(&ptable.lock);
 
-	  begin_op();
-	  iput(curproc->cwd);
-	  end_op();
-	  curproc->cwd = 0;
+  filesput(curproc->files);
+  curproc->files = 0;
 
-	  acquire(&ptable.lock);
+  acquire(&ptable.lock);
 
-	  // Parent might be sleeping in wait().
-	  wakeup1(curproc->parent);
+  // Parent might be sleeping in wait().
+  wakeup1(curproc->parent);
 
-	  // Pass abandoned children to init.
-	  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-		  if(p->parent == curproc){
-			  p->parent = initproc;
-			  if(p->state == ZOMBIE)
-				  wakeup1(initproc);
-		  }
-	  }
+  // Pass abandoned children to init.
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->parent == curproc){
+      p->parent = initproc;
+      if(p->state == ZOMBIE)
+        wakeup1(initproc);
+    }
+  }
 
-	  // Jump into the scheduler, never to return.
-	  curproc->state = ZOMBIE;
-	  if (curproc->stride == 0) {
-		  level = curproc->level;
-		for (i = 0; i <= q_count[level]; i++)
-			if (curproc == q[level][i]) {
-				for (j = i; j <= q_count[level] - 1; j++)
-					q[level][j] = q[level][j + 1];
-				q[level][q_count[level]] = 0;
-				q_count[level]--;
-				break;
-			}
-	} 
-	else {
-		// if p is in stride
-		curproc->pass = 0;
-	}
-	  sched();
-	  panic("zombie exit");
+  // Jump into the scheduler, never to return.
+  // wait() cannot free curproc until sched() has
+  // switched away and released curproc->lock.
+  acquire(&curproc->lock);
+  curproc->state = ZOMBIE;
+  release(&ptable.lock);
+  sched();
+  panic("zombie exit");
+}
+
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
 
+  acquire(&ptable.lock);
+  for(;;){
+    // Scan through table looking for exited children.
+    // LWPs are reaped by thread_join() or exit(), since
+    // their page table belongs to the main thread.
+    havekids = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != curproc || p->is_LWP)
+        continue;
+      havekids = 1;
+      acquire(&p->lock);
+      if(p->state == ZOMBIE){
+        // Found one.
+        pid = p->pid;
+        freevm(p->pgdir);
+        freeproc(p);
+        release(&p->lock);
+        release(&ptable.lock);
+        return pid;
+      }
+      release(&p->lock);
+    }
+
+    // No point waiting if we don't have any children.
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
+}
+
+// Move thread t into the stride client of its process, whose
+// stride is given, requeueing it if it is queued. Only here does
+// the stride of a thread that may be queued change, so t leaves
+// its queue under the class it was queued in.
+// Caller must hold ptable.lock.
+static void
+setclass(struct proc *t, int stride)
+{
+	int queued;
+
+	// Deadline tasks keep their own bandwidth.
+	if (t->dl_runtime)
+		return;
+	acquire(&t->lock);
+	queued = (t->state == RUNNABLE && rqdel(t));
+	t->stride = stride;
+	if (queued)
+		rqadd(t, 0);
+	release(&t->lock);
+}
+
+// Give the process of the caller share percent of the cpu,
+// split among whichever of its threads are runnable.
+// A new stride client starts from the minimum pass on its cpu
+// so that it neither monopolizes the cpu nor waits for the
+// others to catch up.
+int
+set_cpu_share(int share) {
+
+	struct proc *g, *p;
+	struct cpu *c;
+	int stride;
+
+	// no negative share
+	if (share <= 0) {
+		return -1;
+	}
 
-	// if curproc is process and has some threads
-	else if (!curproc->is_LWP && curproc->num_LWP) {
 	acquire(&ptable.lock);
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-		if (p->parent == curproc && p->is_LWP){
-			release(&ptable.lock);
+	g = mainthread(myproc());
 
-		//if (p->parent != curproc || !p->is_LWP)
-		//	continue;
-		for(fd = 0; fd < NOFILE; fd++){
-			if(p->ofile[fd]){
-			  fileclose(p->ofile[fd]);
-			  p->ofile[fd] = 0;
-		  }
-		}
+	// Total stride processes are able to get at most 80% of CPU time.
+	// The threads must have a cpu in common to be queued on.
+	if (mlfq_share + g->cpu_share - share <= 20 || myproc()->dl_runtime ||
+	    g->dl_runtime || g->group != 0 || (g->gmask = gmaskof(g)) == 0) {
+		release(&ptable.lock);
+		return -1;
+	}
 
-		begin_op();
-		iput(p->cwd);
-		end_op();
-		p->cwd = 0;
-
-		acquire(&ptable.lock);
-		p->parent->num_LWP--;
-
-		/*
-		if (!p->parent->num_LWP && p->parent->all_LWP) {
-			p->parent->sz = deallocuvm(p->parent->pgdir, p->parent->sz, p->parent->sz - (p->parent->all_LWP) * 2 * PGSIZE);
-			p->parent->all_LWP = 0;
-		}*/
-        kfree(p->kstack);
-        p->kstack = 0;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-		p->state = UNUSED;
-		if (p->stride == 0) {
-			level = p->level;
-			for (i = 0; i <= q_count[level]; i++)
-				if (p == q[level][i]) {
-					for (j = i; j <= q_count[level] - 1; j++)
-						q[level][j] = q[level][j + 1];
-					q[level][q_count[level]] = 0;
-					q_count[level]--;
-					break;
-				}
-		} 
-		else {
-			// if p is in stride
-			p->pass = 0;
-		}
+	// initialize variables for stride scheduling
+	mlfq_share += g->cpu_share - share;
+	mlfq_stride = (int)(10000 / mlfq_share);
+	if (g->stride == 0) {
+		g->gcpu = (g->gmask & CPUBIT(g->cpu)) ? g->cpu : rqleast(g->gmask);
+		g->ghead = g->gtail = 0;
+		c = &cpus[g->gcpu];
+		acquire(&c->rqlock);
+		g->pass = rqminpass(c);
+		release(&c->rqlock);
+	}
+	g->cpu_share = share;
+	stride = (int)(10000 / share);
+	setclass(g, stride);
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if (p->is_LWP && p->state != UNUSED && mainthread(p) == g)
+			setclass(p, stride);
 
-		// initailize variables for sceduling
-		p->level = 0;
-		p->ticks = 0;
-		mlfq_share += p->cpu_share;
-		mlfq_stride = (int) (10000 / mlfq_share);
-		p->cpu_share = 0;
-		p->stride = 0;
-		p->pass = 0;
-		// initialize variables for LWP
-		p->is_LWP = 0;
-		p->num_LWP = 0;
-		p->all_LWP = 0;
-		p->tid = -1;
-		p->wtid = -1;
-	}}
 	release(&ptable.lock);
+	return share;
+}
 
-	for(fd = 0; fd < NOFILE; fd++){
-		if(curproc->ofile[fd]){
-			fileclose(curproc->ofile[fd]);
-			curproc->ofile[fd] = 0;
-		}
-	}
+// Replace the mlfq parameters with those in mp. Every cpu boosts
+// its queued processes to the top level, so none is left on a
+// level that is no longer in use.
+int
+set_mlfq(struct mlfqparam *mp)
+{
+	struct cpu *c;
+	int i;
 
-	begin_op();
-	iput(curproc->cwd);
-	end_op();
-	curproc->cwd = 0;
+	if (mp->levels < 1 || mp->levels > NMLFQ || mp->boost < 1 ||
+	    mp->wakeboost < 0 || mp->wakeboost > NMLFQ)
+		return -1;
+	for (i = 0; i < mp->levels; i++)
+		if (mp->quantum[i] < 1 || mp->quantum[i] > HZ || mp->allotment[i] < 1)
+			return -1;
 
 	acquire(&ptable.lock);
-	// Parent might be sleeping in wait().
-	wakeup1(curproc->parent);
+	for (i = 0; i < mp->levels; i++) {
+		quantum[i] = mp->quantum[i];
+		allotment[i] = mp->allotment[i];
+	}
+	mlfq_levels = mp->levels;
+	boost_period = mp->boost;
+	wake_boost = mp->wakeboost;
+	for (c = cpus; c < &cpus[ncpu]; c++) {
+		acquire(&c->rqlock);
+		rqboost(c);
+		release(&c->rqlock);
+	}
+	release(&ptable.lock);
+	return 0;
+}
 
+// Copy the current mlfq parameters to mp.
+int
+get_mlfq(struct mlfqparam *mp)
+{
+	int i;
 
-	// Jump into the scheduler, never to return.
-	curproc->state = ZOMBIE;
-	if (curproc->stride == 0) {
-		level = curproc->level;
-		for (i = 0; i <= q_count[level]; i++)
-			if (curproc == q[level][i]) {
-				for (j = i; j <= q_count[level] - 1; j++)
-					q[level][j] = q[level][j + 1];
-				q[level][q_count[level]] = 0;
-				q_count[level]--;
-				break;
-			}
-	} 
-	else {
-		// if p is in stride
-		curproc->pass = 0;
+	acquire(&ptable.lock);
+	mp->levels = mlfq_levels;
+	for (i = 0; i < NMLFQ; i++) {
+		mp->quantum[i] = i < mlfq_levels ? quantum[i] : 0;
+		mp->allotment[i] = i < mlfq_levels ? allotment[i] : 0;
 	}
+	mp->boost = boost_period;
+	mp->wakeboost = wake_boost;
+	release(&ptable.lock);
+	return 0;
+}
 
-	sched();
-	panic("zombie exit");
-  }
-   else if (curproc->is_LWP) {
-	   struct proc * parent = curproc->parent;
-	   acquire(&ptable.lock);
+// Create a scheduling group with share percent of the cpu,
+// taken from the default group like set_cpu_share() does.
+// Returns the id of the group, or -1.
+int
+group_create(int share)
+{
+	int gid;
 
-	   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-		if (p->parent == curproc->parent && p->is_LWP && p != curproc){
-			release(&ptable.lock);
-		for(fd = 0; fd < NOFILE; fd++){
-			if(p->ofile[fd]){
-			  fileclose(p->ofile[fd]);
-			  p->ofile[fd] = 0;
-		  }
-		}
+	if (share <= 0)
+		return -1;
+	acquire(&ptable.lock);
+	for (gid = 1; gid < NGROUP; gid++)
+		if (!groups[gid].used)
+			break;
+	// Total stride processes and groups are able to get at most 80% of CPU time
+	if (gid == NGROUP || mlfq_share - share <= 20) {
+		release(&ptable.lock);
+		return -1;
+	}
+	groups[gid].used = 1;
+	groups[gid].share = share;
+	groups[gid].stride = (int)(10000 / share);
+	groups[gid].nproc = 0;
+	mlfq_share -= share;
+	mlfq_stride = (int)(10000 / mlfq_share);
+	release(&ptable.lock);
+	return gid;
+}
 
-		begin_op();
-		iput(p->cwd);
-		end_op();
-		p->cwd = 0;
-		
-		acquire(&ptable.lock);
-		p->parent->num_LWP--;
-
-		kfree(p->kstack);
-		p->kstack = 0;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-		p->killed = 0;
-		p->state = UNUSED;
-		if (p->stride == 0) {
-			level = p->level;
-			for (i = 0; i <= q_count[level]; i++)
-				if (p == q[level][i]) {
-					for (j = i; j <= q_count[level] - 1; j++)
-						q[level][j] = q[level][j + 1];
-					q[level][q_count[level]] = 0;
-					q_count[level]--;
-					break;
-				}
-		} 
-		else {
-			// if p is in stride
-			p->pass = 0;
-		}
+// Destroy an empty scheduling group and give its share back
+// to the default group.
+int
+group_destroy(int gid)
+{
+	acquire(&ptable.lock);
+	if (gid <= 0 || gid >= NGROUP || !groups[gid].used ||
+	    groups[gid].nproc != 0) {
+		release(&ptable.lock);
+		return -1;
+	}
+	groups[gid].used = 0;
+	mlfq_share += groups[gid].share;
+	mlfq_stride = (int)(10000 / mlfq_share);
+	release(&ptable.lock);
+	return 0;
+}
 
-		// initailize variables for sceduling
-		p->level = 0;
-		p->ticks = 0;
-		mlfq_share += p->cpu_share;
-		mlfq_stride = (int) (10000 / mlfq_share);
-		p->cpu_share = 0;
-		p->stride = 0;
-		p->pass = 0;
-		// initialize variables for LWP
-		p->is_LWP = 0;
-		p->num_LWP = 0;
-		p->all_LWP = 0;
-		p->tid = -1;
-		p->wtid = -1;
-	   }}
-	   release(&ptable.lock);
-
-	   for(fd = 0; fd < NOFILE; fd++){
-		   if(curproc->ofile[fd]){
-			   fileclose(curproc->ofile[fd]);
-			   curproc->ofile[fd] = 0;
-		   }
-	   }
-
-	   begin_op();
-	   iput(curproc->cwd);
-	   end_op();
-	   curproc->cwd = 0;
-
-	   curproc->parent->num_LWP--;
-
-	   if (!parent->num_LWP && parent->all_LWP) {
-		   parent->sz = deallocuvm(parent->pgdir, parent->sz, parent->sz - (parent->all_LWP - 1) * 2 * PGSIZE);
-		   parent->all_LWP = 0;
-	   }
-	   curproc->parent = curproc;
-	   curproc->state = ZOMBIE;
-	   if (curproc->stride == 0) {
-		   level = curproc->level;
-		   for (i = 0; i <= q_count[level]; i++)
-			   if (curproc == q[level][i]) {
-				   for (j = i; j <= q_count[level] - 1; j++)
-					   q[level][j] = q[level][j + 1];
-				   q[level][q_count[level]] = 0;
-				   q_count[level]--;
-				   break;
-			   }
-	   } 
-	   else {
-		   // if p is in stride
-		   curproc->pass = 0;
-	   }
-
-		for(fd = 0; fd < NOFILE; fd++){
-		   if(parent->ofile[fd]){
-			   fileclose(parent->ofile[fd]);
-			   parent->ofile[fd] = 0;
-		   }
-	   }
-
-	   begin_op();
-	   iput(parent->cwd);
-	   end_op();
-	   parent->cwd = 0;
-		
-	   acquire(&ptable.lock);
-	   // Parent might be sleeping in wait().
-	   wakeup1(parent->parent);
-
-	   // Jump into the scheduler, never to return.
-	   parent->state = ZOMBIE;
-		if (parent->stride == 0) {
-			level = parent->level;
-			for (i = 0; i <= q_count[level]; i++)
-				if (parent == q[level][i]) {
-					for (j = i; j <= q_count[level] - 1; j++)
-						q[level][j] = q[level][j + 1];
-					q[level][q_count[level]] = 0;
-					q_count[level]--;
-					break;
-				}
-		} 
-		else {
-			// if p is in stride
-			parent->pass = 0;
-		}
+// Move the process that pid belongs to (0 for the caller),
+// with all its threads, into scheduling group gid; 0 is the
+// default group. Its children fork into the same group.
+// Stride processes are clients of their own and do not join.
+int
+group_join(int gid, int pid)
+{
+	struct proc *p, *g;
+	int queued;
 
-	   sched();
-	   panic("zombie exit");
+	if (pid == 0)
+		pid = myproc()->pid;
 
-   }
+	acquire(&ptable.lock);
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if (p->pid == pid && p->state != UNUSED)
+			break;
+	if (gid < 0 || gid >= NGROUP || (gid != 0 && !groups[gid].used) ||
+	    p == &ptable.proc[NPROC] || mainthread(p)->stride != 0) {
+		release(&ptable.lock);
+		return -1;
+	}
+	g = mainthread(p);
+	// Threads still being created take the group of
+	// their process when they become runnable.
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+		if (p->state == UNUSED || p->state == EMBRYO ||
+		    mainthread(p) != g)
+			continue;
+		acquire(&p->lock);
+		queued = (p->state == RUNNABLE && rqdel(p));
+		if (p->group)
+			groups[p->group].nproc--;
+		p->group = gid;
+		if (p->group)
+			groups[p->group].nproc++;
+		if (queued)
+			rqadd(p, 0);
+		release(&p->lock);
+	}
+	release(&ptable.lock);
+	return 0;
 }
-	
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// Make the caller a deadline task that needs runtime microseconds
+// of cpu time in every period, each within deadline of the start
+// of the period; runtime 0 makes it an mlfq process again.
+// The task is admitted to an allowed cpu with enough bandwidth left,
+// preferring its own, and stays there. Returns -1 if there is none.
 int
-wait(void)
+set_deadline(int runtime, int period, int deadline)
 {
-  struct proc *p;
-  int havekids, pid;
-  int level, i, j;
-  struct proc *curproc = myproc();
-  
-  acquire(&ptable.lock);
-  for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-		// if p is in mlfq, must dequeue!!
-		level = p->level;
-		if (p->stride == 0) {
-			for (i = 0; i <= q_count[level]; i++) {
-				if (p == q[level][i]) {
-					for (j = i; j <= q_count[level] - 1; j++)
-						q[level][j] = q[level][j + 1];
-					q_count[level]--;
-					break;
-				}
-			}	
-		}
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-		// initailize variables for sceduling
-		p->level = 0;
-		p->ticks = 0;
-		mlfq_share += p->cpu_share;
-		mlfq_stride = (int) (10000 / mlfq_share);
-		p->cpu_share = 0;
-		p->stride = 0;
-		p->pass = 0;
-		// initialize variables for LWP
-		p->is_LWP = 0;
-		p->num_LWP = 0;
-		p->all_LWP = 0;
-		p->tid = -1;
-		p->wtid = -1;
-	
-        p->state = UNUSED;
-        release(&ptable.lock);
-        return pid;
-      }
-    }
+	struct proc *p = myproc();
+	int i, best, bw, room, old;
 
-    // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
-      release(&ptable.lock);
-      return -1;
-    }
+	if (runtime < 0 || (runtime > 0 && (runtime > deadline ||
+	    deadline > period || period > DL_MAXPERIOD)))
+		return -1;
+	bw = runtime ? (runtime * 1000 + period - 1) / period : 0;
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
-  }
+	acquire(&ptable.lock);
+	if (p->stride != 0) {
+		release(&ptable.lock);
+		return -1;
+	}
+	old = p->dl_runtime ? p->dl_bw : 0;
+	best = p->cpu;
+	if (runtime > 0) {
+		best = -1;
+		for (i = 0; i < ncpu; i++) {
+			room = DL_MAXBW - cpus[i].dlbw + (i == p->cpu ? old : 0);
+			if (!(p->cpumask & CPUBIT(i)) || bw > room)
+				continue;
+			if (best < 0 || i == p->cpu ||
+			    (best != p->cpu && cpus[i].dlbw < cpus[best].dlbw))
+				best = i;
+		}
+		if (best < 0) {
+			release(&ptable.lock);
+			return -1;
+		}
+	}
+	cpus[p->cpu].dlbw -= old;
+	cpus[best].dlbw += bw;
+
+	acquire(&p->lock);
+	p->dl_runtime = runtime;
+	p->dl_period = period;
+	p->dl_deadline = deadline;
+	p->dl_bw = bw;
+	p->dl_budget = runtime;
+	p->runstart = clocknow();
+	p->dl_abs = p->runstart + deadline;
+	p->dl_ready = 0;
+	p->cpu = best;
+	release(&p->lock);
+	release(&ptable.lock);
+
+	// Requeue as a deadline task on its cpu.
+	yield();
+	return 0;
 }
 
+// Restrict the process or LWP with the given pid (0 for the
+// caller) to the cpus in mask. A queued process moves at once;
+// a running one moves when it next gives up its cpu.
 int
-set_cpu_share(int share) {
+set_affinity(int pid, uint mask)
+{
+	struct proc *p, *g;
+	uint old, gmask;
 
-	struct proc *p, *ip;
-	int min_pass = mlfq_pass;
-	int i, j;
-	
-	// no negative share
-	if (share < 0) {
+	mask &= CPUBIT(ncpu) - 1;
+	if (mask == 0)
 		return -1;
-	}
+	if (pid == 0)
+		pid = myproc()->pid;
 
-	// Total stride processes are able to get at most 80% of CPU time
-	if (mlfq_share - share <= 20) {
+	acquire(&ptable.lock);
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if (p->pid == pid && p->state != UNUSED)
+			break;
+	if (p == &ptable.proc[NPROC]) {
+		release(&ptable.lock);
+		return -1;
+	}
+	// A deadline task may not leave the cpu that admitted it.
+	if (p->dl_runtime && !(mask & CPUBIT(p->cpu))) {
+		release(&ptable.lock);
 		return -1;
 	}
+	acquire(&p->lock);
+	old = p->cpumask;
+	p->cpumask = mask;
+	release(&p->lock);
+
+	// The threads of a stride process are queued together, on a
+	// cpu they may all run on; move them there, or refuse a mask
+	// that leaves them none.
+	g = mainthread(p);
+	gmask = gmaskof(g);
+	if (g->stride && gmask == 0) {
+		acquire(&p->lock);
+		p->cpumask = old;
+		release(&p->lock);
+		release(&ptable.lock);
+		return -1;
+	}
+	g->gmask = gmask;
+	if (g->stride)
+		gmove(g);
+
+	acquire(&p->lock);
+	if (p->state == RUNNABLE && rqdel(p))
+		rqadd(p, 0);
+	release(&p->lock);
+	release(&ptable.lock);
 
-	acquire(&ptable.lock);
+	// Leave a cpu the caller may no longer run on.
+	if (p == myproc() && !(mask & CPUBIT(p->cpu)))
+		yield();
+	return 0;
+}
 
-	// Find minimum pass of process 
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-		if (p->state == RUNNABLE && p->stride != 0)
-			min_pass = (min_pass > p->pass) ? p->pass : min_pass;
-	}
+// Return the cpu mask of the process or LWP with the
+// given pid (0 for the caller), or -1 if there is none.
+int
+get_affinity(int pid)
+{
+	struct proc *p;
+	int mask = -1;
 
-	p = myproc();
+	if (pid == 0)
+		return myproc()->cpumask;
 
-	// delete in mlfq
-	for (i = 0; i <= q_count[p->level]; i++) {
-		if (p == q[p->level][i]) {
-			for (j = i; j < q_count[p->level]; j++)
-				q[p->level][j] = q[p->level][j + 1];
+	acquire(&ptable.lock);
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if (p->pid == pid && p->state != UNUSED) {
+			mask = p->cpumask;
+			break;
 		}
-	}
-	q[p->level][q_count[p->level]] = 0;
-	q_count[p->level]--;
+	release(&ptable.lock);
+	return mask;
+}
 
-	// initialize variables for stride scheduling
-	mlfq_share -= share;
-	mlfq_stride = (int)(10000 / mlfq_share);
-	if(p->num_LWP > 0) {
-		int avg_share = (int)(share / p->num_LWP + 1);
-		p->cpu_share = avg_share;
-		p->stride = (int) (10000 / avg_share);
-		p->pass = min_pass;
-		for (ip = ptable.proc; ip < &ptable.proc[NPROC]; ip++) {
-			if (ip->parent == p) {
-				ip->cpu_share = avg_share;
-				ip->stride = (int) (10000 / avg_share); 
-				ip->pass = min_pass;
-			}
-		}
-	} else {
-		p->cpu_share = share;
-		p->stride = (int)(10000 / share);
-		p->pass = min_pass;
+// p starts running on c: start charging it, and account
+// for the time it waited. Caller must hold p->lock.
+static void
+runbegin(struct cpu *c, struct proc *p)
+{
+	p->runstart = clocknow();
+	if (p->readyat) {
+		p->waittime += p->runstart - p->readyat;
+		p->readyat = 0;
 	}
-
-	release(&ptable.lock);
-	return share;
+	c->nswitch++;
 }
 
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - choose a process to run from this cpu's run queue
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
 void
 scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, *g;
   struct cpu *c = mycpu();
   c->proc = 0;
-  int i, j;
-  int level;
-  int mlfq_turn = 0;
-  
+
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    acquire(&ptable.lock);
-	struct proc *min = 0;
-	int min_pass = mlfq_pass;
-
-	// Find minimum pass of process 
-	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-	  if (p->state == RUNNABLE && p->cpu_share != 0 && p->pass <= min_pass) {
-		min = p;
-		min_pass = p->pass;
-	  }
-	}
+    if((p = rqpick(c)) == 0){
+      // Nothing to do here; look for work on other cpus,
+      // and halt until an interrupt if there is none.
+      rqbalance(c);
+      if(c->nrunnable == 0)
+        rqidle(c);
+      continue;
+    }
 
-	// if not mlfq is minimum pass
-	if (min) {
-		p = min;
-		p->pass += p->stride;
-		c->proc = p;
-		switchuvm(p);
-		p->state = RUNNING;
-		swtch(&c->scheduler, p->context);
-		switchkvm();
-		c->proc = 0;
-	} 
-	// if mlfq is minimum pass
-	else {
-		mlfq_pass += mlfq_stride;
-		mlfq_turn = 1;
+    // Start the rest of p's gang on the other cpus.
+    if((g = pclient(p)) != 0 && g->gang)
+      gangsend(c, g);
 
-		// boosting!!!!
-		if (totalticks >= 100) {
-			//cprintf("[do boosting!]\n");
-			for (i = 0, j = q_count[0] + 1; i <= q_count[1]; i++, j++) {
-				p = q[1][i];
-				q[0][j] = p;
-				p->level = 0;
-				p->ticks = 0;
-				q[1][i] = 0;
-				q_count[0]++;
-			}
-			q_count[1] = -1;
-			for (i = 0, j = q_count[0] + 1; i <= q_count[2]; i++, j++) {
-				p = q[2][i];
-				q[0][j] = p;
-				p->level = 0;
-				p->ticks = 0;
-				q[2][i] = 0;
-				q_count[0]++;
-			}
-			q_count[2] = -1;
-			totalticks = 0;
-		}
+    // Arm the timer for the slice of p.
+    if(p->dl_runtime)
+      clockslice(p->dl_budget);
+    else
+      clockslice((pclient(p) ? STRIDE_QUANTUM : quantum[qlevel(p)]) * TICKUS);
+
+    // Switch to chosen process.  It is the process's job
+    // to release p->lock and then reacquire it
+    // before jumping back to us.
+    acquire(&p->lock);
+    if(p->state == RUNNABLE){
+      c->proc = p;
+      runbegin(c, p);
+      switchuvm(p);
+      p->state = RUNNING;
+      swtch(&c->scheduler, p->context);
+      switchkvm();
+      // p may have handed the cpu to another process with
+      // schedto(); whichever comes back holds its own lock.
+      p = c->proc;
+      c->proc = 0;
+    }
+    release(&p->lock);
+  }
+}
 
-		for (level = 0; level < 3; level++) {
-			// if upper level queue has process
-			if (mlfq_turn) {
-				if ((level == 1 && q_count[0] != -1) ||
-						(level == 2 && q_count[1] != -1 
-						 && q_count[2] != -1))  {
-					level = -1;
-					continue;
-				}	
-			}
-			if (q_count[level]!= -1 && mlfq_turn) {
-				for (i = 0; i <= q_count[level]; i++) {
-					if (q[level][i]->state != RUNNABLE) 
-						continue;
-					//cprintf("[%d] cnt_queue : %d, tid = %d\n", level, q_count[level], q[level][i]->tid);
-					p = q[level][i];
-					c->proc = q[level][i];
-					switchuvm(p);
-					p->state = RUNNING;
-					swtch(&c->scheduler, p->context);
-					switchkvm();
-					mlfq_turn = 0;
-
-					// If a process uses too much CPU time, it will be moved to a lower-priority queue.
-					if (level != 2 && p->ticks >= allotment[level]) {
-						q_count[level + 1]++;
-						c->proc->level++;
-						c->proc->ticks = 0;
-						q[level + 1][q_count[level + 1]] = c->proc;
-
-						// delete process in queue
-						for (j = i; j <= q_count[level] - 1; j++)
-							q[level][j] = q[level][j + 1];
-
-						q[level][q_count[level]] = 0;
-						q_count[level]--;
-					}
-					c->proc = 0;
-				}
-			}
-		}
+// Charge p for the time it ran since it was last charged,
+// in whole ticks plus the microseconds left over. Time is
+// measured rather than sampled on timer interrupts, so a
+// process cannot dodge its allotment by sleeping just before
+// a tick. Caller must hold p->lock.
+static void
+runcharge(struct proc *p)
+{
+	uint64 now = clocknow();
+	uint ran = now - p->runstart;
+
+	p->tickus += ran;
+	p->runstart = now;
+	p->runtime += ran;
+	mycpu()->busytime += ran;
+	if (p->dl_runtime)
+		p->dl_budget -= ran;
+	while (p->tickus >= TICKUS) {
+		p->tickus -= TICKUS;
+		p->ticks++;
 	}
-	release(&ptable.lock);
-  }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -843,27 +2054,116 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&p->lock))
+    panic("sched p->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  runcharge(p);
+  if(p->state == RUNNABLE)
+    p->nivcsw++;
+  else
+    p->nvcsw++;
   intena = mycpu()->intena;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
+  schedtail();
+}
+
+// Like sched(), but switch straight to np without a pass through
+// the scheduler if np is queued on this cpu and nothing queued
+// there must run before it. np runs for the rest of the slice.
+// np must be a process the caller woke, see wakeuppeer().
+static void
+schedto(struct proc *np)
+{
+  int intena;
+  struct proc *p = myproc();
+  struct cpu *c = mycpu();
+
+  // Deadline tasks must be picked in deadline order.
+  if(np == p || np->cpu != c - cpus || np->dl_runtime ||
+     c->dlhead || c->preempt){
+    sched();
+    return;
+  }
+  // Holding p->lock while taking np->lock cannot deadlock:
+  // a running process has p->cpu set to its own cpu, so no
+  // other cpu in schedto() is after p->lock.
+  acquire(&np->lock);
+  if(np->state != RUNNABLE || !rqdel(np)){
+    release(&np->lock);
+    sched();
+    return;
+  }
+  // The balancer or set_affinity() may have moved np since the
+  // check above; it is settled now that np is off the queue.
+  if(np->cpu != c - cpus || !(np->cpumask & CPUBIT(c - cpus))){
+    rqadd(np, 1);
+    release(&np->lock);
+    sched();
+    return;
+  }
+  // Charge np's client as if rqpick() had chosen it.
+  acquire(&c->rqlock);
+  rqcharge(c, np);
+  release(&c->rqlock);
+
+  if(p->state == RUNNING)
+    panic("schedto running");
+  runcharge(p);
+  p->nvcsw++;
+  np->cpu = c - cpus;
+  c->proc = np;
+  switchuvm(np);
+  np->state = RUNNING;
+  runbegin(c, np);
+
+  // np releases p->lock once it runs, as scheduler() would.
+  c->handoff = p;
+  intena = c->intena;
+  swtch(&p->context, np->context);
+  mycpu()->intena = intena;
+  schedtail();
+}
+
+// Finish a switch to the current process. If the previous process
+// handed over the cpu with schedto(), release its lock.
+static void
+schedtail(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev = c->handoff;
+
+  if(prev){
+    c->handoff = 0;
+    release(&prev->lock);
+  }
 }
 
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&p->lock);  //DOC: yieldlock
+  p->state = RUNNABLE;
+  p->handoff = 0;
+  runcharge(p);
+  // If a process uses too much CPU time, it will be moved to a lower-priority queue.
+  if (p->stride == 0 && p->level < mlfq_levels - 1 && p->ticks >= allotment[p->level]) {
+	  p->level++;
+	  p->ndemote++;
+	  p->ticks = 0;
+	  p->tickus = 0;
+  }
+  rqadd(p, 0);
   sched();
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -872,8 +2172,9 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding p->lock from scheduler.
+  schedtail();
+  release(&myproc()->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -887,103 +2188,173 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
+// Chain of the wait channel hash table for chan.
+static struct chanhash*
+chanhash(void *chan)
+{
+  return &chantab[((uint)chan * 2654435761U) >> 26];
+}
+
+// Caller must hold h->lock.
+static void
+chanlink(struct chanhash *h, struct proc *p, void *chan)
+{
+  p->chan = chan;
+  p->cprev = 0;
+  p->cnext = h->head;
+  if(h->head)
+    h->head->cprev = p;
+  h->head = p;
+}
+
+// Caller must hold h->lock.
+static void
+chanunlink(struct chanhash *h, struct proc *p)
+{
+  if(p->cprev)
+    p->cprev->cnext = p->cnext;
+  else
+    h->head = p->cnext;
+  if(p->cnext)
+    p->cnext->cprev = p->cprev;
+  p->cnext = p->cprev = 0;
+  p->chan = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
-  int level;
-  int i, j;
-  
+  struct proc *np;
+  struct chanhash *h;
+
   if(p == 0)
     panic("sleep");
 
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
+  // Must acquire the lock of chan's chain before
+  // releasing lk. wakeup(chan) takes the same lock,
+  // so we can be guaranteed that we won't miss any
+  // wakeup, and it's okay to release lk.
+  h = chanhash(chan);
+  acquire(&h->lock);  //DOC: sleeplock1
+  release(lk);
 
-  // if p is in mlfq, must delete in mlfq
-  if (p->stride == 0) {
-	  level = p->level;
-	  for (i = 0; i <= q_count[level]; i++)
-		  if (p == q[level][i]) {
-			  for (j = i; j <= q_count[level] - 1; j++)
-				  q[level][j] = q[level][j + 1];
-			  q[level][q_count[level]] = 0;
-			  q_count[level]--;
-			  break;
-		  }
-  } 
-  else {
-  // if p is in stride
-	  p->pass = 0;
-  }
+  // Must acquire p->lock in order to
+  // change p->state and then call sched.
+  acquire(&p->lock);
 
   // Go to sleep.
-  p->chan = chan;
+  chanlink(h, p, chan);
   p->state = SLEEPING;
-  
-  sched();
-
-  // Tidy up.
-  p->chan = 0;
+  release(&h->lock);
+
+  // Hand the cpu to the peer we last woke, if we can.
+  np = p->handoff;
+  p->handoff = 0;
+  if(np)
+    schedto(np);
+  else
+    sched();
+
+  // Tidy up. wakeup() has taken p off the chain,
+  // but kill() wakes p without doing so.
+  release(&p->lock);
+  acquire(&h->lock);
+  if(p->chan)
+    chanunlink(h, p);
+  release(&h->lock);
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);  //DOC: sleeplock2
 }
 
 //PAGEBREAK!
+// Wake up at most max processes sleeping on chan, which is
+// an I/O completion if io is set (see wakeproc).
+// Returns how many, and sets *last to the last one woken.
+// The caller may hold ptable.lock, but must not hold
+// the p->lock of any process.
+static int
+wakechan(void *chan, int max, int io, struct proc **last)
+{
+  struct proc *p, *next;
+  struct chanhash *h = chanhash(chan);
+  int n = 0;
+
+  acquire(&h->lock);
+  for(p = h->head; p && n < max; p = next){
+    next = p->cnext;
+    if(p->chan != chan)
+      continue;
+    acquire(&p->lock);
+    if(p->state == SLEEPING){
+      chanunlink(h, p);
+      wakeproc(p, io);
+      *last = p;
+      n++;
+    }
+    release(&p->lock);
+  }
+  release(&h->lock);
+  return n;
+}
+
 // Wake up all processes sleeping on chan.
-// The ptable lock must be held.
+// The caller may hold ptable.lock.
 static void
 wakeup1(void *chan)
 {
-  struct proc *p, *sp;
-  int i;
-  int min_pass = mlfq_pass;
+  struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan) {
-		p->ticks = 0;
-		p->level = 0;
-		p->state = RUNNABLE;
-		// if process is in mlfq
-		if (p->stride == 0) {
-			q_count[0]++;
-			for (i = q_count[0]; i > 0; i--)
-				q[0][i] = q[0][i - 1];
-			q[0][0] = p;
-		} // if process is in stride
-		else {
-			for (sp = ptable.proc; sp < &ptable.proc[NPROC]; sp++)
-				if (sp != p && sp->stride && sp->state == RUNNABLE)
-					min_pass = (min_pass > sp->pass) ? sp->pass : min_pass;
-			p->pass = min_pass;
-		}
-	}
+  wakechan(chan, NPROC, 0, &p);
 }
 
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
   wakeup1(chan);
-  release(&ptable.lock);
+}
+
+// Wake up all processes sleeping on chan for a device, when
+// the I/O they wait for completes. Only these wakeups earn the
+// wake boost; a process cannot climb the mlfq by waking itself
+// through a futex, a pipe or a lock.
+void
+wakeupio(void *chan)
+{
+  struct proc *p;
+
+  wakechan(chan, NPROC, 1, &p);
+}
+
+// Wake up all processes sleeping on chan, from a process that
+// is likely to sleep soon waiting for the one it woke, like the
+// two ends of a pipe. If it woke exactly one, it hands its cpu
+// straight to that one when it sleeps (see schedto), instead of
+// leaving it to wait for the next scheduler pass.
+void
+wakeuppeer(void *chan)
+{
+  struct proc *p, *curproc = myproc();
+
+  if(wakechan(chan, NPROC, 0, &p) == 1 && curproc)
+    curproc->handoff = p;
+}
+
+// Wake up at most n processes sleeping on chan.
+// Returns how many it woke.
+int
+wakeupn(void *chan, int n)
+{
+  struct proc *p;
+
+  return wakechan(chan, n, 0, &p);
 }
 
 // Kill the process with the given pid.
@@ -997,10 +2368,7 @@ kill(int pid)
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      killproc(p);
       release(&ptable.lock);
       return 0;
     }
@@ -1045,17 +2413,159 @@ procdump(void)
     cprintf("\n");
   }
 }
-// Create threads within the process. 
-// From that point on, 
+
+// Fill st with the scheduler statistics of every cpu and every
+// process and LWP. The counters are read without stopping the
+// cpus, so they are only consistent with each other roughly.
+int
+getschedstats(struct schedstats *st)
+{
+	struct proc *p, *g;
+	struct procstat *ps;
+	struct cpu *c;
+	uint64 now;
+	int i;
+
+	acquire(&ptable.lock);
+	now = clocknow();
+	st->now = now;
+	st->ncpu = ncpu;
+	for (i = 0; i < ncpu; i++) {
+		c = &cpus[i];
+		st->cpu[i].busytime = c->busytime;
+		// Count the running slice that has not been charged yet.
+		if ((p = c->proc) != 0 && now > p->runstart)
+			st->cpu[i].busytime += now - p->runstart;
+		st->cpu[i].nrunnable = c->nrunnable;
+		st->cpu[i].nswitch = c->nswitch;
+	}
+	st->nproc = 0;
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+		if (p->state == UNUSED)
+			continue;
+		ps = &st->proc[st->nproc++];
+		ps->pid = p->pid;
+		ps->ppid = p->parent ? p->parent->pid : 0;
+		ps->tid = p->is_LWP ? p->tid : -1;
+		ps->state = p->state;
+		safestrcpy(ps->name, p->name, sizeof(ps->name));
+		ps->cpu = p->cpu;
+		ps->level = p->level;
+		ps->group = p->group;
+		g = pclient(p);
+		ps->share = g ? g->cpu_share : 0;
+		ps->pass = g ? g->pass : 0;
+		ps->runtime = p->runtime;
+		if (p->state == RUNNING && now > p->runstart)
+			ps->runtime += now - p->runstart;
+		ps->waittime = p->waittime;
+		if (p->readyat && now > p->readyat)
+			ps->waittime += now - p->readyat;
+		ps->nvcsw = p->nvcsw;
+		ps->nivcsw = p->nivcsw;
+		ps->ndemote = p->ndemote;
+		ps->nboost = p->nboost;
+	}
+	release(&ptable.lock);
+	return st->nproc;
+}
+
+// Each LWP has a user stack of STACKSIZE bytes. A joined thread's
+// stack goes to the pool of its process and the next thread_create()
+// takes it from there, so a process that keeps creating and joining
+// threads stays the same size. Up to NSTACKIDLE pooled stacks stay
+// mapped; the pages of the others are freed until they are reused.
+// The pool is protected by pgdirlock.
+#define STACKSIZE (2 * PGSIZE)
+#define STACKUNMAPPED 1	// Pool entry flag: its pages are not mapped
+
+// Take a stack for a new thread of the process mp, from the pool
+// if it has one. Return its base, or 0 if out of memory.
+static uint
+stackget(struct proc *mp)
+{
+	uint base;
+
+	if (mp->nstackpool > 0) {
+		base = mp->stackpool[--mp->nstackpool];
+		if (!(base & STACKUNMAPPED))
+			return base;
+		base &= ~STACKUNMAPPED;
+		if (allocuvm(mp->pgdir, base, base + STACKSIZE) == 0) {
+			mp->nstackpool++;
+			return 0;
+		}
+		return base;
+	}
+	base = PGROUNDUP(mp->sz);
+	if (allocuvm(mp->pgdir, base, base + STACKSIZE) == 0)
+		return 0;
+	mp->sz = base + STACKSIZE;
+	return base;
+}
+
+// Put the stack at base back into the pool of mp, unmapping it
+// if NSTACKIDLE others are mapped and unmap is set. There is no
+// TLB shootdown, so the caller sets unmap only when no other
+// thread of the process is running.
+static void
+stackput(struct proc *mp, uint base, int unmap)
+{
+	int i, nmapped;
+
+	if (mp->nstackpool == NELEM(mp->stackpool))
+		return;
+	nmapped = 0;
+	for (i = 0; i < mp->nstackpool; i++)
+		if (!(mp->stackpool[i] & STACKUNMAPPED))
+			nmapped++;
+	if (unmap && nmapped >= NSTACKIDLE) {
+		deallocuvm(mp->pgdir, base + STACKSIZE, base);
+		lcr3(V2P(mp->pgdir));
+		base |= STACKUNMAPPED;
+	}
+	mp->stackpool[mp->nstackpool++] = base;
+}
+
+// Drop the pooled stacks sbrk() has shrunk mp below, so that
+// the heap may grow over them again.
+static void
+stackprune(struct proc *mp)
+{
+	int i, n;
+
+	n = 0;
+	for (i = 0; i < mp->nstackpool; i++)
+		if ((mp->stackpool[i] & ~STACKUNMAPPED) + STACKSIZE <= mp->sz)
+			mp->stackpool[n++] = mp->stackpool[i];
+	mp->nstackpool = n;
+}
+
+// Is a thread of the process mp other than the caller running?
+// Caller must hold ptable.lock.
+static int
+siblingrunning(struct proc *mp)
+{
+	struct proc *p;
+
+	for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+		if (p != myproc() && p->state == RUNNING && p->pgdir == mp->pgdir)
+			return 1;
+	return 0;
+}
+
+// Create threads within the process.
+// From that point on,
 // the execution routine assigned to each thread starts.
 // Return thread id
 int
-thread_create(thread_t * thread, void * (*start_routine)(void *), void *arg) 
+thread_create(thread_t * thread, void * (*start_routine)(void *), void *arg)
 {
-	struct proc *np, *p;
+	struct proc *np;
 	struct proc *curproc = myproc();
+	struct proc *mp = mainthread(curproc);
 	uint sp, ustack[2];
-	int i, avg_share;
+	int i;
 
 	// Allocate thread
 	if((np = allocproc()) == 0) {
@@ -1063,26 +2573,23 @@ thread_create(thread_t * thread, void * (*start_routine)(void *), void *arg)
 	}
 
 	acquire(&pgdirlock);
-	// assgin new stack memory for LWP
-	curproc->sz = PGROUNDUP(curproc->sz);
-	if ((curproc->sz = allocuvm(curproc->pgdir, curproc->sz, curproc->sz + 2 * PGSIZE)) == 0) {
-		return -1;
+	// assgin stack memory for LWP
+	if ((np->ustack = stackget(mp)) == 0) {
+		release(&pgdirlock);
+		goto bad;
 	}
 
-	sp = curproc->sz;
+	sp = np->ustack + STACKSIZE;
 
 	// Set thread options
 	np->is_LWP = 1;
-	np->parent = curproc;
-	np->tid = curproc->num_LWP++;
+	np->parent = mp;
 	np->all_LWP++;
 	np->pgdir = curproc->pgdir;
-	np->sz = curproc->sz;
+	np->sz = mp->sz;
+	np->cpumask = curproc->cpumask;
 	*np->tf = *curproc->tf;
 
-	// set return value
-	*thread = np->tid;
-	
 	release(&pgdirlock);
 
 	ustack[0] = 0xffffffff;
@@ -1090,81 +2597,91 @@ thread_create(thread_t * thread, void * (*start_routine)(void *), void *arg)
 
 	sp -= 8;
 
-	if (copyout(np->pgdir, sp, ustack, 8) < 0)
-		return -1;
+	if (copyout(np->pgdir, sp, ustack, 8) < 0) {
+		acquire(&pgdirlock);
+		stackput(mp, np->ustack, 0);
+		release(&pgdirlock);
+		goto bad;
+	}
 
 	np->tf->eax = 0;
 	np->tf->eip = (uint)start_routine;
 	np->tf->esp = sp;
 
-	for(i = 0; i < NOFILE; i++)
-		if(curproc->ofile[i])
-			np->ofile[i] = filedup(curproc->ofile[i]);
-	np->cwd = idup(curproc->cwd);
+	// Threads share the open files and current directory.
+	np->files = filesdup(curproc->files);
 
 	safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
 	switchuvm(curproc);
 
+	// A thread of a stride process joins its stride client,
+	// which splits the share among its runnable threads, and
+	// runs in the scheduling group of its process. Both may be
+	// changed for the whole process until np is runnable.
 	acquire(&ptable.lock);
-
-	// If main thread is in stride scheduling, 
-	// assign new stride to all threads
-	
-	np->state = RUNNABLE;
-
-	if(np->parent->cpu_share != 0) {
-		avg_share = (int)(np->parent->cpu_share / np->parent->num_LWP + 1);
-		np->parent->cpu_share = avg_share;
-		np->parent->stride = (int) (10000 / avg_share);
-		for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-			if (p->parent == np->parent) {
-				p->cpu_share = np->parent->cpu_share;
-				p->stride = (int) (10000 / p->cpu_share); 
-				p->pass = np->parent->pass;
-			}
-		}
+	// exit() of the main thread sets killed before it kills
+	// and reaps the threads in the table, so a thread added
+	// now would be missed.
+	if (mp->killed || mp->state == ZOMBIE) {
+		release(&ptable.lock);
+		filesput(np->files);
+		np->files = 0;
+		acquire(&pgdirlock);
+		stackput(mp, np->ustack, 0);
+		release(&pgdirlock);
+		goto bad;
 	}
+	// Take the lowest free slot of the LWP table, which the
+	// main thread keeps for the whole process: any thread may
+	// join np, and exit() finds every thread there.
+	for (i = 0; mp->lwp[i]; i++)
+		;
+	np->tid = i;
+	mp->lwp[i] = np;
+	mp->num_LWP++;
+	*thread = np->tid;
+	np->stride = mp->stride;
+	np->group = curproc->group;
+	if (np->group)
+		groups[np->group].nproc++;
 
+	acquire(&np->lock);
+	np->state = RUNNABLE;
+	rqadd(np, 0);
+	release(&np->lock);
 	release(&ptable.lock);
 
 	return 0;
+
+bad:
+	acquire(&ptable.lock);
+	acquire(&np->lock);
+	freeproc(np);
+	release(&np->lock);
+	release(&ptable.lock);
+	return -1;
 }
 
-// You must provide a method to terminate the thread in it. 
-// As the main function do, 
-// you call the thread_exit function at the last of a thread routine. 
+// You must provide a method to terminate the thread in it.
+// As the main function do,
+// you call the thread_exit function at the last of a thread routine.
 // Through this function, you must able to return a result of a thread.
 void
-thread_exit(void * retval) 
+thread_exit(void * retval)
 {
-	int fd;
 	struct proc *curproc = myproc();
-	//int i;
-	//int min_pass = mlfq_pass;
 	struct proc *p;
-	//struct proc  * sp;
-	int i, j, level;
 
 	if (curproc == initproc)
 		panic("init existing");
 
-	for(fd = 0; fd < NOFILE; fd++){
-		if(curproc->ofile[fd]){
-			fileclose(curproc->ofile[fd]);
-			curproc->ofile[fd] = 0;
-		}
-	}
-
-	begin_op();
-	iput(curproc->cwd);
-	end_op();
-	curproc->cwd = 0;
+	filesput(curproc->files);
+	curproc->files = 0;
 
-	//cprintf("try ptable lock~\n");
 	acquire(&ptable.lock);
-	//cprintf("lock ptablelock~~\n");
-	wakeup1(curproc->parent);
+	// A thread might be sleeping in thread_join() or exit().
+	wakeup1(&curproc->parent->lwp[curproc->tid]);
 
 	for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
 		if (p->parent == curproc) {
@@ -1174,110 +2691,78 @@ thread_exit(void * retval)
 		}
 	}
 
+	acquire(&curproc->lock);
 	curproc->state = ZOMBIE;
-	//cprintf("zombie tid : %d\n", curproc->tid);
 	curproc->retval = retval;
-	// if p is in mlfq, must delete in mlfq
-	if (curproc->stride == 0) {
-		level = curproc->level;
-		for (i = 0; i <= q_count[level]; i++)
-			if (curproc == q[level][i]) {
-				for (j = i; j <= q_count[level] - 1; j++)
-					q[level][j] = q[level][j + 1];
-				q[level][q_count[level]] = 0;
-				q_count[level]--;
-				break;
-			}
-	} 
-	else {
-		// if p is in stride
-		curproc->pass = 0;
-	}
+	release(&ptable.lock);
 
 	sched();
 	panic("zombie exit");
 }
 
-// You must provide a method to wait for the thread 
-// specified by the argument to terminate. 
-// If that thread has already terminated, 
-// then this returns immediately. 
-// In the join function, you have to clean up the resources 
-// allocated to the thread such as a page table, allocated memories and stacks. 
+// You must provide a method to wait for the thread
+// specified by the argument to terminate.
+// If that thread has already terminated,
+// then this returns immediately.
+// In the join function, you have to clean up the resources
+// allocated to the thread such as a page table, allocated memories and stacks.
 // You can get the return value of thread through this function.
 int
 thread_join(thread_t thread, void **retval)
 {
 	struct proc *p;
-	int level, i, j, havekids;
+	int mine;
+	uint base;
+	void *rv;
 	struct proc *curproc = myproc();
+	struct proc *mp = mainthread(curproc);
+
+	// Any thread of the process can join any other. Another
+	// joiner may reap p while this one sleeps, and its slot
+	// be taken by a new thread, so look again every time.
+	if (thread >= NPROC)
+		return -1;
 	curproc->wtid = thread;
 
 	acquire(&ptable.lock);
+	if ((p = mp->lwp[thread]) == 0 || p == curproc) {
+		release(&ptable.lock);
+		return -1;
+	}
 	for(;;){
-		havekids = 0;
-		// Scan through table looking for exited children.
-		for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-			if(p->parent != curproc)
-				continue;
-			//cprintf("try find tid : %d, %d\n", thread, p->tid);
-			havekids = 1;
-			if(p->state == ZOMBIE && p->tid == thread){
-				//cprintf("find %d, tid : %d\n", thread, p->tid);
-				//cprintf("tid : %d\n",p->tid);
-				// if p is in mlfq, must dequeue!!
-				level = p->level;
-				if (p->stride == 0) {
-					for (i = 0; i <= q_count[level]; i++) {
-						if (p == q[level][i]) {
-							for (j = i; j <= q_count[level] - 1; j++)
-								q[level][j] = q[level][j + 1];
-							q_count[level]--;
-							break;
-						}
-					}	
-				}
-
-				*retval = p->retval;
-
-				// Found one.
-				kfree(p->kstack);
-				p->kstack = 0;
-				p->pid = 0;
-				p->parent = 0;
-				p->name[0] = 0;
-				p->killed = 0;
-				// initailize variables for sceduling
-				p->level = 0;
-				p->ticks = 0;
-				mlfq_share += p->cpu_share;
-				mlfq_stride = (int) (10000 / mlfq_share);
-				p->cpu_share = 0;
-				p->stride = 0;
-				p->pass = 0;
-				// initialize variables for LWP
-				p->is_LWP = 0;
-				p->num_LWP = 0;
-				p->all_LWP = 0;
-				p->tid = -1;
-				p->wtid = -1;
-
-				p->state = UNUSED;
-				release(&ptable.lock);
-				return 0;
+		if (mp->lwp[thread] != p) {
+			release(&ptable.lock);
+			return -1;
+		}
+		acquire(&p->lock);
+		if(p->state == ZOMBIE){
+			rv = p->retval;
+			base = p->ustack;
+			mine = (p->pgdir == mp->pgdir);
+			freeproc(p);
+			release(&p->lock);
+			mp->lwp[thread] = 0;
+			mp->num_LWP--;
+			mp->gmask = gmaskof(mp);
+			// Its stack is for the next thread_create().
+			if (mine) {
+				acquire(&pgdirlock);
+				stackput(mp, base, !siblingrunning(mp));
+				release(&pgdirlock);
 			}
+			release(&ptable.lock);
+			*retval = rv;
+			return 0;
 		}
-			
-		// No point waiting if we don't have any children.
-		if(curproc->killed || !havekids){
+		release(&p->lock);
+
+		if(curproc->killed){
 			release(&ptable.lock);
 			return -1;
 		}
 
-		// Wait for children to exit.  (See wakeup1 call in proc_exit.)
-		sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+		// Only p wakes this channel, in thread_exit().
+		sleep(&mp->lwp[thread], &ptable.lock);  //DOC: wait-sleep
 	}
-	return 0;
 }
 
-
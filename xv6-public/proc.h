@@ -1,3 +1,13 @@
+// The part of a scheduling group on one cpu: an mlfq of its
+// processes queued there, which competes with the stride clients
+// of the cpu as one client.
+struct grq {
+  struct proc *qhead[NMLFQ];   // FIFO list per level
+  struct proc *qtail[NMLFQ];
+  int pass;                    // Pass of the group on this cpu
+  int nqueued;                 // Number of processes on the lists
+};
+
 // Per-CPU state
 struct cpu {
   uchar apicid;                // Local APIC ID
@@ -8,12 +18,34 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+
+  // Run queue of this cpu. A process is on it while RUNNABLE.
+  struct spinlock rqlock;      // Protects the run queue fields below
+  int nrunnable;               // Number of processes on the run queue
+  struct grq grq[NGROUP];      // mlfq of each scheduling group, 0 is the default
+  uint gactive;                // Groups other than 0 with processes queued, bit per group
+  struct proc *dlhead;         // Runnable deadline tasks, sorted on dl_abs
+  struct proc *dlthrottled;    // Throttled deadline tasks, sorted on dl_ready
+  uint64 dlwake;               // clocknow() when a throttled one is due, 0 if none
+  int dlbw;                    // Admitted deadline bandwidth, per mille; ptable.lock
+  volatile uint preempt;       // Must give up the cpu to a deadline task
+  struct proc *handoff;        // Process whose lock to release after schedto()
+  struct proc *gang;           // Gang thread sent by another cpu, see gangsend()
+  struct proc *sheap[NPROC];   // Stride clients, min-heap on pass
+  int nsheap;                  // Number of stride clients
+  uint lastboost;              // ticks at the last boosting
+  int boosts;                  // boostepoch at the last boosting
+  uint lastbalance;            // ticks at the last balancing
+  uint64 sliceend;             // clocknow() when the running slice ends, 0 if none
+  uint64 armed;                // clocknow() the lapic timer is armed for, 0 if stopped
+  volatile uint idle;          // Is halted waiting for work?
+  uint64 busytime;             // Microseconds spent running processes
+  uint nswitch;                // Number of switches to a process
 };
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
 extern int mlfq_share;
-extern int totalticks;
 
 //PAGEBREAK: 17
 // Saved registers for kernel context switches.
@@ -38,6 +70,7 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
+  struct spinlock lock;        // Protects state, chan and the switch to this process
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
@@ -48,26 +81,80 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct files *files;         // Open files and current directory
   char name[16];               // Process name (debugging)
 
+  // run queue
+  int cpu;	// Index of the cpu whose run queue holds this process
+  uint cpumask;	// cpus this process may run on, bit i for cpus[i]
+  int queued;	// Is on the run queue of its cpu?
+  struct proc *qnext;	// Next process in the same mlfq level, deadline list or stride client
+  struct proc *qprev;	// Previous process in the same list
+  int boosts;	// cpu's boosts when last synced, see rqsync()
+  uint64 runstart;	// clocknow() when last charged, see runcharge()
+
+  // wait channel hash chain, protected by the chain's lock
+  struct proc *cnext;
+  struct proc *cprev;
+  struct proc *handoff;	// Peer last woken by wakeuppeer(), see schedto()
+
+  // priority lent by a sleeplock waiter, see pidonate()
+  void *pilock;	// Sleeplock the loan is for, 0 if none
+  struct proc *piclient;	// Stride client to run under, or 0
+  int pilevel;	// mlfq level to run at at most
+
+  // timer wheel, protected by tickslock
+  uint deadline;	// Timer wheel step to wake up at in sleep()
+  struct proc *tnext;	// Next process in the same wheel slot
+  struct proc **tpprev;	// Link pointing at this process, 0 if not on the wheel
+
   // mlfq
+  int group;	// Scheduling group, 0 for the default one
   int level;
-  int ticks;
+  int ticks;	// Ticks run at this level
+  uint tickus;	// Microseconds run beyond ticks
   
   // stride
   int stride;
   int cpu_share;
   int pass;
+  int hidx;	// Index in the stride heap of its cpu, -1 if not there
+  struct proc *ghead;	// Queued threads of this stride client, see mainthread()
+  struct proc *gtail;
+  int gcpu;	// cpu whose stride heap holds this client
+  uint gmask;	// cpus all threads of this client may run on, see gmaskof()
+  int gang;	// Run the threads of this client together?
+
+  // deadline, times in microseconds
+  int dl_runtime;	// Budget per period, 0 if not a deadline task
+  int dl_period;
+  int dl_deadline;	// Relative deadline of each job
+  int dl_bw;	// Admitted bandwidth, per mille
+  int dl_budget;	// Budget left for the current job
+  uint64 dl_abs;	// Absolute deadline of the current job
+  uint64 dl_ready;	// Start of the next period while throttled
+  int dl_throttled;	// Has overrun its budget, see dlrefresh()
+
+  // statistics, see getschedstats()
+  uint64 runtime;	// Microseconds run
+  uint64 waittime;	// Microseconds runnable but not running
+  uint64 readyat;	// clocknow() when it became runnable, 0 while not
+  uint nvcsw;	// Switches away to sleep or exit
+  uint nivcsw;	// Switches away while still runnable
+  uint ndemote;	// mlfq demotions
+  uint nboost;	// mlfq boosts out of a lower level
 
   // lwp
   int is_LWP;	// Is LWP?
   int num_LWP;	// Number of Active LWP
+  struct proc *lwp[NPROC];	// Main thread: its LWPs not joined yet, indexed by tid
   int all_LWP;	// all number of LWP
   int tid;	// If this thread is LWP, must have tid
   int wtid;		// If main thread wating a thread, use wtid
   void* retval;	// return value of thread
+  uint ustack;	// Base of the user stack of this LWP
+  uint stackpool[NPROC];	// Stacks of joined LWPs to reuse, see stackput()
+  int nstackpool;
 
 };
 
@@ -0,0 +1,250 @@
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "schedstat.h"
+
+// Scheduler benchmark. Reports, in microseconds or percent:
+//  - wakeup-to-run latency percentiles under load
+//  - achieved cpu fraction against the share asked for
+//  - mlfq response time of an I/O-bound process among cpu hogs,
+//    and the slowdown of a cpu-bound one
+//  - cost of a context switch between two processes
+// Times come from uptime_us(). Works with any number of cpus;
+// the tests that need contention pin themselves to cpu 0.
+
+#define NLAT 200
+#define NSHARE 3
+#define SHARETICKS 300
+#define NRESP 50
+#define NSWITCH 5000
+#define WORK 2000000
+
+struct schedstats st;
+uint lat[NLAT];
+
+// Burn cpu for a fixed amount of work.
+void
+work(int n)
+{
+	volatile int i;
+
+	for (i = 0; i < n; i++)
+		;
+}
+
+// Fork a process that burns cpu until killed.
+int
+hog(void)
+{
+	int pid;
+
+	if ((pid = fork()) == 0)
+		for (;;)
+			work(WORK);
+	return pid;
+}
+
+void
+killall(int *pid, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		kill(pid[i]);
+	for (i = 0; i < n; i++)
+		wait();
+}
+
+void
+sort(uint *a, int n)
+{
+	int i, j;
+	uint x;
+
+	for (i = 1; i < n; i++) {
+		x = a[i];
+		for (j = i; j > 0 && a[j - 1] > x; j--)
+			a[j] = a[j - 1];
+		a[j] = x;
+	}
+}
+
+// Microseconds the process pid has run, from getschedstats().
+uint
+runtime(int pid)
+{
+	int i;
+
+	getschedstats(&st);
+	for (i = 0; i < st.nproc; i++)
+		if (st.proc[i].pid == pid)
+			return st.proc[i].runtime;
+	return 0;
+}
+
+// A sleeper is woken through a pipe, with one hog per cpu running,
+// and measures how long it took from the write to its running.
+void
+latency(int ncpu)
+{
+	int fd[2], res[2], pid[NCPU], i;
+	uint t;
+
+	pipe(fd);
+	pipe(res);
+	if (fork() == 0) {
+		for (i = 0; i < NLAT; i++) {
+			if (read(fd[0], &t, sizeof(t)) != sizeof(t))
+				break;
+			t = uptime_us() - t;
+			write(res[1], &t, sizeof(t));
+		}
+		exit();
+	}
+	for (i = 0; i < ncpu; i++)
+		pid[i] = hog();
+	for (i = 0; i < NLAT; i++) {
+		sleep(1);
+		t = uptime_us();
+		write(fd[1], &t, sizeof(t));
+		read(res[0], &lat[i], sizeof(lat[i]));
+	}
+	wait();
+	killall(pid, ncpu);
+	close(fd[0]);
+	close(fd[1]);
+	close(res[0]);
+	close(res[1]);
+
+	sort(lat, NLAT);
+	printf(1, "wakeup latency (us): p50 %d  p90 %d  p99 %d  max %d\n",
+	       lat[NLAT / 2], lat[NLAT * 9 / 10], lat[NLAT * 99 / 100], lat[NLAT - 1]);
+}
+
+// Stride processes asking for different shares and an mlfq hog
+// share cpu 0; report what each got.
+void
+fairness(void)
+{
+	static int share[NSHARE] = { 10, 20, 40 };
+	int pid[NSHARE + 1], i;
+	uint base[NSHARE + 1], t0, t1, got;
+
+	for (i = 0; i < NSHARE; i++) {
+		if ((pid[i] = fork()) == 0) {
+			set_affinity(0, 1);
+			if (set_cpu_share(share[i]) < 0)
+				printf(1, "set_cpu_share(%d) failed\n", share[i]);
+			for (;;)
+				work(WORK);
+		}
+	}
+	pid[NSHARE] = hog();
+	set_affinity(pid[NSHARE], 1);
+
+	// Let everyone settle, then measure over a fixed interval.
+	sleep(10);
+	t0 = uptime_us();
+	for (i = 0; i < NSHARE + 1; i++)
+		base[i] = runtime(pid[i]);
+	sleep(SHARETICKS);
+	t1 = uptime_us();
+	printf(1, "cpu share (%%): ");
+	for (i = 0; i < NSHARE + 1; i++) {
+		got = (runtime(pid[i]) - base[i]) / ((t1 - t0) / 100);
+		if (i < NSHARE)
+			printf(1, "asked %d got %d  ", share[i], got);
+		else
+			printf(1, "mlfq got %d", got);
+	}
+	printf(1, "\n");
+	killall(pid, NSHARE + 1);
+}
+
+// An I/O-bound process sleeps and then does a little work, among
+// cpu hogs on cpu 0. Its response time is how much later than
+// asked it gets through. A cpu-bound job's slowdown is its run
+// time among the hogs over its run time alone.
+void
+response(void)
+{
+	int pid[3], i;
+	uint t, sum, max, alone, loaded;
+
+	set_affinity(0, 1);
+	t = uptime_us();
+	work(WORK * 10);
+	alone = uptime_us() - t;
+
+	for (i = 0; i < 3; i++)
+		pid[i] = hog();
+	sleep(50);
+
+	sum = max = 0;
+	for (i = 0; i < NRESP; i++) {
+		t = uptime_us();
+		msleep(10);
+		work(WORK / 100);
+		t = uptime_us() - t - 10000;
+		sum += t;
+		if (t > max)
+			max = t;
+	}
+	printf(1, "mlfq I/O-bound response (us): avg %d  max %d\n", sum / NRESP, max);
+
+	t = uptime_us();
+	work(WORK * 10);
+	loaded = uptime_us() - t;
+	printf(1, "mlfq cpu-bound slowdown with 3 hogs: %d.%d x\n",
+	       loaded / alone, loaded % alone * 10 / alone);
+	killall(pid, 3);
+	set_affinity(0, (1 << st.ncpu) - 1);
+}
+
+// Two processes on cpu 0 bounce a byte through pipes; each
+// round trip is two switches.
+void
+switchcost(void)
+{
+	int ping[2], pong[2], i;
+	char c = 0;
+	uint t;
+
+	pipe(ping);
+	pipe(pong);
+	set_affinity(0, 1);
+	if (fork() == 0) {
+		for (i = 0; i < NSWITCH; i++) {
+			read(ping[0], &c, 1);
+			write(pong[1], &c, 1);
+		}
+		exit();
+	}
+	t = uptime_us();
+	for (i = 0; i < NSWITCH; i++) {
+		write(ping[1], &c, 1);
+		read(pong[0], &c, 1);
+	}
+	t = uptime_us() - t;
+	wait();
+	close(ping[0]);
+	close(ping[1]);
+	close(pong[0]);
+	close(pong[1]);
+	printf(1, "context switch (us): %d.%d\n",
+	       t / (2 * NSWITCH), t % (2 * NSWITCH) * 10 / (2 * NSWITCH));
+	set_affinity(0, (1 << st.ncpu) - 1);
+}
+
+int
+main(int argc, char * argv[])
+{
+	getschedstats(&st);
+	printf(1, "schedbench: %d cpus\n", st.ncpu);
+	latency(st.ncpu);
+	fairness();
+	response();
+	switchcost();
+	exit();
+}
@@ -0,0 +1,35 @@
+// Scheduler statistics, filled in by getschedstats().
+// Times are in microseconds.
+
+struct procstat {
+  int pid;
+  int ppid;
+  int tid;              // Thread id of an LWP, -1 for a main thread
+  int state;            // enum procstate
+  char name[16];
+  int cpu;              // Last cpu it ran or was queued on
+  int level;            // mlfq level
+  int group;            // Scheduling group
+  int share;            // cpu share of its stride client, 0 if none
+  int pass;             // Pass of its stride client
+  uint64 runtime;       // Time run
+  uint64 waittime;      // Time runnable but not running
+  uint nvcsw;           // Switches away to sleep or exit
+  uint nivcsw;          // Switches away while still runnable
+  uint ndemote;         // mlfq demotions
+  uint nboost;          // mlfq boosts out of a lower level
+};
+
+struct cpustat {
+  uint64 busytime;      // Time running processes
+  int nrunnable;        // Processes queued
+  uint nswitch;         // Processes switched to
+};
+
+struct schedstats {
+  uint64 now;           // Time since boot
+  int ncpu;
+  struct cpustat cpu[NCPU];
+  int nproc;            // Entries used in proc
+  struct procstat proc[NPROC];
+};
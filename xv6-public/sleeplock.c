@@ -6,8 +6,8 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
 void
@@ -17,6 +17,7 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->holder = 0;
 }
 
 void
@@ -24,10 +25,13 @@ acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   while (lk->locked) {
+    // Don't let the holder keep us waiting at its lower priority.
+    pidonate(lk->holder, lk);
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->holder = myproc();
   release(&lk->lk);
 }
 
@@ -35,8 +39,11 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  if(lk->holder)
+    piundo(lk->holder, lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->holder = 0;
   wakeup(lk);
   release(&lk->lk);
 }
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -17,9 +18,7 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(!uvalid(addr, 4))
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -28,21 +27,19 @@ fetchint(uint addr, int *ip)
 // Fetch the nul-terminated string at addr from the current process.
 // Doesn't actually copy the string - just sets *pp to point at it.
 // Returns length of string, not including nul.
+// Each page is checked as the scan reaches it.
 int
 fetchstr(uint addr, char **pp)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
+  char *s;
 
-  if(addr >= curproc->sz)
-    return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
+  for(s = *pp; ; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && !uvalid((uint)s, 1))
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
-  return -1;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -59,11 +56,10 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || !uvalid((uint)i, size))
     return -1;
   *pp = (char*)i;
   return 0;
@@ -111,6 +107,20 @@ extern int sys_set_cpu_share(void);
 extern int sys_thread_create(void);
 extern int sys_thread_exit(void);
 extern int sys_thread_join(void);
+extern int sys_msleep(void);
+extern int sys_set_affinity(void);
+extern int sys_get_affinity(void);
+extern int sys_set_deadline(void);
+extern int sys_group_create(void);
+extern int sys_group_join(void);
+extern int sys_group_destroy(void);
+extern int sys_set_gang(void);
+extern int sys_getschedstats(void);
+extern int sys_uptime_us(void);
+extern int sys_set_mlfq(void);
+extern int sys_get_mlfq(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -142,6 +152,20 @@ static int (*syscalls[])(void) = {
 [SYS_thread_create]	sys_thread_create,
 [SYS_thread_exit]	sys_thread_exit,
 [SYS_thread_join]	sys_thread_join,
+[SYS_msleep]	sys_msleep,
+[SYS_set_affinity]	sys_set_affinity,
+[SYS_get_affinity]	sys_get_affinity,
+[SYS_set_deadline]	sys_set_deadline,
+[SYS_group_create]	sys_group_create,
+[SYS_group_join]	sys_group_join,
+[SYS_group_destroy]	sys_group_destroy,
+[SYS_set_gang]	sys_set_gang,
+[SYS_getschedstats]	sys_getschedstats,
+[SYS_uptime_us]	sys_uptime_us,
+[SYS_set_mlfq]	sys_set_mlfq,
+[SYS_get_mlfq]	sys_get_mlfq,
+[SYS_futex_wait]	sys_futex_wait,
+[SYS_futex_wake]	sys_futex_wake,
 };
 
 void
@@ -153,6 +177,8 @@ syscall(void)
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
+    // A handoff is only for a sleep in the call that woke the peer.
+    curproc->handoff = 0;
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
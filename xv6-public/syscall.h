@@ -28,3 +28,17 @@
 #define SYS_thread_create	27
 #define SYS_thread_exit	28
 #define SYS_thread_join	29
+#define SYS_msleep	30
+#define SYS_set_affinity	31
+#define SYS_get_affinity	32
+#define SYS_set_deadline	33
+#define SYS_group_create	34
+#define SYS_group_join	35
+#define SYS_group_destroy	36
+#define SYS_set_gang	37
+#define SYS_getschedstats	38
+#define SYS_uptime_us	39
+#define SYS_set_mlfq	40
+#define SYS_get_mlfq	41
+#define SYS_futex_wait	42
+#define SYS_futex_wake	43
@@ -9,30 +9,42 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return the corresponding struct file. If other threads share
+// the file table, one of them may close the descriptor meanwhile, so
+// then the caller gets its own reference to the file, says *ref, and
+// must drop it with fdput(). Only this thread can share an unshared
+// table, so reading files->ref without the lock is safe.
 static int
-argfd(int n, int *pfd, struct file **pf)
+argfd(int n, struct file **pf, int *ref)
 {
   int fd;
-  struct file *f;
+  struct files *fs = myproc()->files;
 
-  if(argint(n, &fd) < 0)
-    return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(argint(n, &fd) < 0 || fd < 0 || fd >= NOFILE)
     return -1;
-  if(pfd)
-    *pfd = fd;
-  if(pf)
-    *pf = f;
-  return 0;
+  if((*ref = fs->ref > 1)){
+    acquire(&fs->lock);
+    if((*pf = fs->ofile[fd]) != 0)
+      filedup(*pf);
+    release(&fs->lock);
+  } else
+    *pf = fs->ofile[fd];
+  return *pf ? 0 : -1;
+}
+
+static void
+fdput(struct file *f, int ref)
+{
+  if(ref)
+    fileclose(f);
 }
 
 // Allocate a file descriptor for the given file.
@@ -41,14 +53,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct files *fs = myproc()->files;
 
+  acquire(&fs->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(fs->ofile[fd] == 0){
+      fs->ofile[fd] = f;
+      release(&fs->lock);
       return fd;
     }
   }
+  release(&fs->lock);
   return -1;
 }
 
@@ -56,13 +71,16 @@ int
 sys_dup(void)
 {
   struct file *f;
-  int fd;
+  int fd, ref;
 
-  if(argfd(0, 0, &f) < 0)
+  if(argfd(0, &f, &ref) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if(!ref)
+    filedup(f);
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -70,24 +88,28 @@ int
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, ref;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, &f, &ref) < 0)
     return -1;
-  return fileread(f, p, n);
+  n = fileread(f, p, n);
+  fdput(f, ref);
+  return n;
 }
 
 int
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, ref;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, &f, &ref) < 0)
     return -1;
-  return filewrite(f, p, n);
+  n = filewrite(f, p, n);
+  fdput(f, ref);
+  return n;
 }
 
 int
@@ -95,10 +117,16 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct files *fs = myproc()->files;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&fs->lock);
+  f = fs->ofile[fd];
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
+  if(f == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -108,10 +136,13 @@ sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
+  int r, ref;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argptr(1, (void*)&st, sizeof(*st)) < 0 || argfd(0, &f, &ref) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fdput(f, ref);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -373,9 +404,9 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
-  struct proc *curproc = myproc();
-  
+  struct inode *ip, *old;
+  struct files *fs = myproc()->files;
+
   begin_op();
   if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
     end_op();
@@ -388,9 +419,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(curproc->cwd);
+  acquire(&fs->lock);
+  old = fs->cwd;
+  fs->cwd = ip;
+  release(&fs->lock);
+  iput(old);
   end_op();
-  curproc->cwd = ip;
   return 0;
 }
 
@@ -426,6 +460,7 @@ sys_pipe(void)
   int *fd;
   struct file *rf, *wf;
   int fd0, fd1;
+  struct files *fs = myproc()->files;
 
   if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
@@ -433,9 +468,17 @@ sys_pipe(void)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
-    fileclose(rf);
+    if(fd0 >= 0){
+      // Unless another thread has closed fd0 already.
+      acquire(&fs->lock);
+      if(fs->ofile[fd0] == rf)
+        fs->ofile[fd0] = 0;
+      else
+        rf = 0;
+      release(&fs->lock);
+    }
+    if(rf)
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
@@ -5,7 +5,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "schedstat.h"
+#include "mlfq.h"
 
 int
 sys_fork(void)
@@ -59,7 +62,6 @@ sys_yield(void)
 	check += stride_share;
 	if (check > 100) {
 		p->ticks++;
-		totalticks++;
 		check -= 100;
 	}
 	yield();
@@ -82,6 +84,141 @@ sys_set_cpu_share(void)
 	return set_cpu_share(share);
 }
 
+// reserve runtime microseconds in every period,
+// each within deadline of the start of the period
+int
+sys_set_deadline(void)
+{
+	int runtime, period, deadline;
+
+	if (argint(0, &runtime) < 0 || argint(1, &period) < 0 ||
+	    argint(2, &deadline) < 0)
+		return -1;
+	return set_deadline(runtime, period, deadline);
+}
+
+// sleep while the word at addr holds val
+int
+sys_futex_wait(void)
+{
+	int addr, val;
+
+	if (argint(0, &addr) < 0 || argint(1, &val) < 0)
+		return -1;
+	return futex_wait(addr, val);
+}
+
+// wake up to n threads sleeping on the word at addr
+int
+sys_futex_wake(void)
+{
+	int addr, n;
+
+	if (argint(0, &addr) < 0 || argint(1, &n) < 0)
+		return -1;
+	return futex_wake(addr, n);
+}
+
+// set the number of mlfq levels, their quantum and allotment,
+// the boost period and the boost on wakeups from I/O
+int
+sys_set_mlfq(void)
+{
+	struct mlfqparam *mp;
+
+	if (argptr(0, (void*)&mp, sizeof(*mp)) < 0)
+		return -1;
+	return set_mlfq(mp);
+}
+
+// get the current mlfq parameters
+int
+sys_get_mlfq(void)
+{
+	struct mlfqparam *mp;
+
+	if (argptr(0, (void*)&mp, sizeof(*mp)) < 0)
+		return -1;
+	return get_mlfq(mp);
+}
+
+// create a scheduling group with a cpu share(%)
+int
+sys_group_create(void)
+{
+	int share;
+
+	if (argint(0, &share) < 0)
+		return -1;
+	return group_create(share);
+}
+
+// move a process and its threads into a scheduling group
+int
+sys_group_join(void)
+{
+	int gid, pid;
+
+	if (argint(0, &gid) < 0 || argint(1, &pid) < 0)
+		return -1;
+	return group_join(gid, pid);
+}
+
+// destroy an empty scheduling group
+int
+sys_group_destroy(void)
+{
+	int gid;
+
+	if (argint(0, &gid) < 0)
+		return -1;
+	return group_destroy(gid);
+}
+
+// restrict a process to a set of cpus, bit i for cpu i
+int
+sys_set_affinity(void)
+{
+	int pid, mask;
+
+	if (argint(0, &pid) < 0 || argint(1, &mask) < 0)
+		return -1;
+	return set_affinity(pid, mask);
+}
+
+// get the set of cpus a process may run on
+int
+sys_get_affinity(void)
+{
+	int pid;
+
+	if (argint(0, &pid) < 0)
+		return -1;
+	return get_affinity(pid);
+}
+
+// run the threads of the process together on distinct cpus
+int
+sys_set_gang(void)
+{
+	int on;
+
+	if (argint(0, &on) < 0)
+		return -1;
+	return set_gang(on);
+}
+
+// copy the scheduler statistics of all cpus and processes
+int
+sys_getschedstats(void)
+{
+	struct schedstats *st;
+
+	if (argptr(0, (void*)&st, sizeof(*st)) < 0)
+		return -1;
+	return getschedstats(st);
+}
+
 int
 sys_thread_create(void)
 {
@@ -89,7 +226,8 @@ sys_thread_create(void)
 	void* start_routine;
 	void* arg;
 
-	argint(0, (int*)&thread);
+	if (argptr(0, (char**)&thread, sizeof(*thread)) < 0)
+		return -1;
 	argint(1, (int*)&start_routine);
 	argint(2, (int*)&arg);
 	return thread_create(thread, start_routine, arg);
@@ -109,7 +247,8 @@ sys_thread_join(void)
 	thread_t thread;
 	void** retval;
 	argint(0, (int*)&thread);
-	argint(1, (int*)&retval);
+	if (argptr(1, (char**)&retval, sizeof(*retval)) < 0)
+		return -1;
 	return thread_join(thread, retval);
 }
 
@@ -131,21 +270,24 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n < 0)
+    n = 0;
+  return timersleep((uint64)n * TICKUS);
+}
+
+// Sleep for at least n milliseconds.
+// The timer wheel has millisecond resolution.
+int
+sys_msleep(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0 || n < 0)
+    return -1;
+  return timersleep((uint64)n * 1000);
 }
 
 // return how many clock tick interrupts have occurred
@@ -156,7 +298,15 @@ sys_uptime(void)
   uint xticks;
 
   acquire(&tickslock);
+  clockupdate();
   xticks = ticks;
   release(&tickslock);
   return xticks;
 }
+
+// return microseconds since start, modulo 2^32.
+int
+sys_uptime_us(void)
+{
+  return (uint)clocknow();
+}
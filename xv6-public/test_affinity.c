@@ -0,0 +1,65 @@
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "schedstat.h"
+
+#define NSAMPLE 20
+
+struct schedstats st;
+
+// The cpu the calling process is running on, or -1.
+int
+mycpu(void)
+{
+	int i, pid;
+
+	pid = getpid();
+	if (getschedstats(&st) < 0)
+		return -1;
+	for (i = 0; i < st.nproc; i++)
+		if (st.proc[i].pid == pid)
+			return st.proc[i].cpu;
+	return -1;
+}
+
+// Pin a child to each cpu in turn and check, while it spins,
+// that it runs on that cpu only and that the mask sticks.
+int
+main(int argc, char * argv[])
+{
+	int all, cpu, pid, i, j, on;
+	volatile int x = 0;
+
+	all = get_affinity(0);
+	printf(1, "cpu mask: %x\n", all);
+	if (set_affinity(0, 0) != -1)
+		printf(1, "empty mask accepted\n");
+	if (get_affinity(-1) != -1)
+		printf(1, "bad pid accepted\n");
+
+	for (cpu = 0; all & (1 << cpu); cpu++) {
+		pid = fork();
+		if (pid == 0) {
+			if (set_affinity(0, 1 << cpu) < 0)
+				printf(1, "set_affinity(%d) failed\n", cpu);
+			for (i = 0; i < NSAMPLE; i++) {
+				for (j = 0; j < 1000000; j++)
+					x++;
+				if ((on = mycpu()) != cpu) {
+					printf(1, "pinned to cpu %d, ran on %d\n", cpu, on);
+					break;
+				}
+			}
+			if (get_affinity(0) != 1 << cpu)
+				printf(1, "mask of cpu %d lost\n", cpu);
+			exit();
+		}
+		if (get_affinity(pid) == -1)
+			printf(1, "no mask for child %d\n", pid);
+	}
+	while (wait() >= 0)
+		;
+	printf(1, "test_affinity done\n");
+	exit();
+}
@@ -0,0 +1,62 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// A deadline task that needs 3ms every 10ms runs next to
+// cpu-bound mlfq and stride processes, and admission control
+// refuses more bandwidth than a cpu has.
+int
+main(int argc, char * argv[])
+{
+	int i, n, start, loops, pid[2];
+	volatile int x = 0;
+
+	if (set_deadline(20000, 10000, 10000) != -1)
+		printf(1, "runtime > period accepted\n");
+	if (set_deadline(1000, 10000, 20000) != -1)
+		printf(1, "deadline > period accepted\n");
+
+	// Pin everything to one cpu so they compete.
+	set_affinity(0, 1);
+	for (i = 0; i < 2; i++) {
+		if ((pid[i] = fork()) == 0) {
+			if (i == 1)
+				set_cpu_share(20);
+			for (;;)
+				x++;
+		}
+	}
+
+	if (set_deadline(3000, 10000, 10000) < 0) {
+		printf(1, "set_deadline failed\n");
+		goto out;
+	}
+	if (fork() == 0) {
+		// A second task does not fit next to the first one.
+		if (set_deadline(7000, 10000, 10000) != -1)
+			printf(1, "overcommitted deadline task admitted\n");
+		exit();
+	}
+	wait();
+
+	// Count 10ms periods in which the task got to run.
+	start = uptime();
+	n = 0;
+	while (uptime() - start < 200) {
+		loops = 0;
+		for (i = 0; i < 100000; i++)
+			loops++;
+		n++;
+		msleep(10);
+	}
+	printf(1, "deadline task ran %d jobs in 2 seconds\n", n);
+	set_deadline(0, 0, 0);
+
+out:
+	kill(pid[0]);
+	kill(pid[1]);
+	while (wait() >= 0)
+		;
+	printf(1, "test_deadline done\n");
+	exit();
+}
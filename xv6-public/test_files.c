@@ -0,0 +1,48 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+int fd = -1;
+int pfd[2];
+
+void*
+opener(void *arg)
+{
+	fd = open("test_files.tmp", O_CREATE | O_RDWR);
+	close(pfd[1]);
+	mkdir("test_files.dir");
+	chdir("test_files.dir");
+	thread_exit(0);
+	return 0;
+}
+
+// LWPs share one file table and current directory: a file a
+// thread opens, a descriptor it closes and its chdir() are all
+// seen by the main thread once it has joined.
+int
+main(int argc, char * argv[])
+{
+	thread_t t;
+	void *ret;
+	char c;
+
+	pipe(pfd);
+	thread_create(&t, opener, 0);
+	thread_join(t, &ret);
+	if (fd < 0 || write(fd, "x", 1) != 1)
+		printf(1, "fd %d opened by a thread not usable\n", fd);
+	if (write(pfd[1], "x", 1) != -1)
+		printf(1, "fd closed by a thread still open\n");
+	if (read(pfd[0], &c, 1) != 0)
+		printf(1, "pipe still has a writer\n");
+	close(fd);
+	close(pfd[0]);
+	if (open("../test_files.tmp", O_RDONLY) < 0)
+		printf(1, "chdir in a thread not seen\n");
+	chdir("..");
+	unlink("test_files.tmp");
+	unlink("test_files.dir");
+	printf(1, "test_files done\n");
+	exit();
+}
@@ -0,0 +1,69 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 4
+#define NITER 20000
+
+// 0 unlocked, 1 locked, 2 locked with waiters
+volatile int mutex;
+int counter;
+
+void
+lock(void)
+{
+	int c;
+
+	if ((c = __sync_val_compare_and_swap(&mutex, 0, 1)) == 0)
+		return;
+	if (c != 2)
+		c = __sync_lock_test_and_set(&mutex, 2);
+	while (c != 0) {
+		futex_wait(&mutex, 2);
+		c = __sync_lock_test_and_set(&mutex, 2);
+	}
+}
+
+void
+unlock(void)
+{
+	if (__sync_fetch_and_sub(&mutex, 1) != 1) {
+		mutex = 0;
+		futex_wake(&mutex, 1);
+	}
+}
+
+void*
+worker(void *arg)
+{
+	int i;
+
+	for (i = 0; i < NITER; i++) {
+		lock();
+		counter++;
+		unlock();
+	}
+	thread_exit(0);
+	return 0;
+}
+
+// Threads increment a counter under a futex-based mutex;
+// the count must come out exact.
+int
+main(int argc, char * argv[])
+{
+	thread_t t[NTHREAD];
+	void *ret;
+	int i;
+
+	for (i = 0; i < NTHREAD; i++)
+		thread_create(&t[i], worker, 0);
+	for (i = 0; i < NTHREAD; i++)
+		thread_join(t[i], &ret);
+	if (counter != NTHREAD * NITER)
+		printf(1, "counter %d, expected %d\n", counter, NTHREAD * NITER);
+	if (futex_wait(&mutex, 1) != -1)
+		printf(1, "futex_wait did not see the changed value\n");
+	printf(1, "test_futex done\n");
+	exit();
+}
@@ -0,0 +1,76 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 4
+#define NPHASE 200
+#define WORK 200000
+
+volatile int arrived;
+volatile int phase;
+
+// Wait until all threads have finished the current phase.
+void
+barrier(void)
+{
+	int my = phase;
+
+	if (__sync_add_and_fetch(&arrived, 1) == NTHREAD) {
+		arrived = 0;
+		phase = my + 1;
+	} else {
+		while (phase == my)
+			;
+	}
+}
+
+void*
+worker(void *arg)
+{
+	volatile int i;
+	int n;
+
+	for (n = 0; n < NPHASE; n++) {
+		for (i = 0; i < WORK; i++)
+			;
+		barrier();
+	}
+	thread_exit(0);
+	return 0;
+}
+
+// Run NTHREAD threads through NPHASE barrier-separated phases,
+// without and then with gang mode, and report the time taken.
+int
+run(int gang)
+{
+	thread_t t[NTHREAD];
+	void *ret;
+	int i, start;
+
+	set_gang(gang);
+	arrived = 0;
+	phase = 0;
+	start = uptime();
+	for (i = 0; i < NTHREAD; i++)
+		thread_create(&t[i], worker, 0);
+	for (i = 0; i < NTHREAD; i++)
+		thread_join(t[i], &ret);
+	return uptime() - start;
+}
+
+int
+main(int argc, char * argv[])
+{
+	int plain, gang;
+
+	if (set_cpu_share(40) < 0) {
+		printf(1, "set_cpu_share failed\n");
+		exit();
+	}
+	plain = run(0);
+	gang = run(1);
+	printf(1, "without gang: %d ticks, with gang: %d ticks\n", plain, gang);
+	printf(1, "test_gang done\n");
+	exit();
+}
@@ -0,0 +1,69 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NBIG 8
+#define RUNTICKS 300
+
+// Count for RUNTICKS ticks and report the count, tagged,
+// through the pipe.
+void
+worker(int fd, int tag)
+{
+	int start, msg[2];
+
+	msg[0] = tag;
+	msg[1] = 0;
+	start = uptime();
+	while (uptime() - start < RUNTICKS)
+		msg[1]++;
+	write(fd, msg, sizeof(msg));
+	exit();
+}
+
+// Put one process in a group and NBIG in another with the same
+// share, all on one cpu. The lone process should get about as
+// much cpu as all of the others together.
+int
+main(int argc, char * argv[])
+{
+	int small, big, fd[2], i, msg[2], count[2];
+
+	if ((small = group_create(20)) < 0 || (big = group_create(20)) < 0) {
+		printf(1, "group_create failed\n");
+		exit();
+	}
+	if (pipe(fd) < 0) {
+		printf(1, "pipe failed\n");
+		exit();
+	}
+	set_affinity(0, 1);
+
+	if (fork() == 0) {
+		group_join(small, 0);
+		worker(fd[1], 0);
+	}
+	if (fork() == 0) {
+		group_join(big, 0);
+		for (i = 0; i < NBIG; i++)
+			if (fork() == 0)
+				worker(fd[1], 1);
+		for (i = 0; i < NBIG; i++)
+			wait();
+		exit();
+	}
+
+	count[0] = count[1] = 0;
+	for (i = 0; i < NBIG + 1; i++) {
+		if (read(fd[0], msg, sizeof(msg)) != sizeof(msg))
+			break;
+		count[msg[0]] += msg[1];
+	}
+	wait();
+	wait();
+	printf(1, "small group: %d, big group: %d\n", count[0], count[1]);
+	if (group_destroy(small) < 0 || group_destroy(big) < 0)
+		printf(1, "group_destroy failed\n");
+	printf(1, "test_group done\n");
+	exit();
+}
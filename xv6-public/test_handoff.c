@@ -0,0 +1,42 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define ROUNDS 10000
+
+// Bounce a byte between two processes pinned to the same cpu
+// through a pair of pipes, and report the round trips per second.
+int
+main(int argc, char * argv[])
+{
+	int ping[2], pong[2], i, start, elapsed;
+	char c = 0;
+
+	if (pipe(ping) < 0 || pipe(pong) < 0) {
+		printf(1, "pipe failed\n");
+		exit();
+	}
+	set_affinity(0, 1);
+	if (fork() == 0) {
+		for (i = 0; i < ROUNDS; i++) {
+			if (read(ping[0], &c, 1) != 1)
+				break;
+			write(pong[1], &c, 1);
+		}
+		exit();
+	}
+
+	start = uptime();
+	for (i = 0; i < ROUNDS; i++) {
+		write(ping[1], &c, 1);
+		if (read(pong[0], &c, 1) != 1) {
+			printf(1, "round %d failed\n", i);
+			break;
+		}
+	}
+	elapsed = uptime() - start;
+	wait();
+	printf(1, "%d round trips in %d ticks\n", i, elapsed);
+	printf(1, "test_handoff done\n");
+	exit();
+}
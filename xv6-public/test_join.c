@@ -0,0 +1,73 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 32
+#define NROUND 100
+
+void*
+worker(void *arg)
+{
+	thread_exit(arg);
+	return 0;
+}
+
+// Create a thread and exit without joining it, passing its tid on.
+void*
+spawner(void *arg)
+{
+	thread_t t;
+
+	if (thread_create(&t, worker, arg) < 0)
+		thread_exit((void*)-1);
+	thread_exit((void*)t);
+	return 0;
+}
+
+// Threads are joined out of creation order; each join must get
+// its own thread's value. Joined tids are free for reuse, and
+// joining a tid twice or one never created fails. A thread
+// created by another thread belongs to the process: any thread
+// joins it, and exit() reaps the ones left.
+int
+main(int argc, char * argv[])
+{
+	thread_t t[NTHREAD];
+	void *ret;
+	uint us;
+	int i, r;
+
+	for (i = 0; i < NTHREAD; i++)
+		if (thread_create(&t[i], worker, (void*)(i + 100)) < 0)
+			printf(1, "thread_create %d failed\n", i);
+	for (i = NTHREAD - 1; i >= 0; i--)
+		if (thread_join(t[i], &ret) < 0 || (int)ret != i + 100)
+			printf(1, "join of thread %d got %d\n", i, (int)ret);
+	if (thread_join(t[0], &ret) != -1)
+		printf(1, "second join of a thread succeeded\n");
+	if (thread_join(NTHREAD + 1, &ret) != -1)
+		printf(1, "join of an unknown tid succeeded\n");
+	thread_create(&t[0], worker, 0);
+	if (t[0] != 0)
+		printf(1, "tid %d, expected 0 to be reused\n", t[0]);
+	thread_join(t[0], &ret);
+
+	thread_create(&t[0], spawner, (void*)7);
+	if (thread_join(t[0], &ret) < 0 || (int)ret < 0)
+		printf(1, "spawner failed\n");
+	else if (thread_join((thread_t)ret, &ret) < 0 || (int)ret != 7)
+		printf(1, "join of a thread's thread got %d\n", (int)ret);
+
+	us = uptime_us();
+	for (r = 0; r < NROUND; r++) {
+		for (i = 0; i < NTHREAD; i++)
+			thread_create(&t[i], worker, 0);
+		for (i = 0; i < NTHREAD; i++)
+			thread_join(t[i], &ret);
+	}
+	us = uptime_us() - us;
+	printf(1, "fork-join of %d threads: %d us per round\n", NTHREAD, us / NROUND);
+	thread_create(&t[0], spawner, 0);
+	printf(1, "test_join done\n");
+	exit();
+}
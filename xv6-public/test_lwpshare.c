@@ -0,0 +1,55 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 4
+#define RUNTICKS 300
+
+volatile int done;
+int count[NTHREAD];
+
+// Count until told to stop. Odd threads sleep now and then,
+// so their time goes to the runnable threads of the process.
+void*
+worker(void *arg)
+{
+	int id = (int)arg;
+
+	while (!done) {
+		count[id]++;
+		if ((id & 1) && count[id] % 100000 == 0)
+			sleep(5);
+	}
+	thread_exit(0);
+	return 0;
+}
+
+// Give a process a cpu share and check that its threads
+// split it among themselves.
+int
+main(int argc, char * argv[])
+{
+	thread_t t[NTHREAD];
+	void *ret;
+	int i, start;
+
+	if (set_cpu_share(40) < 0) {
+		printf(1, "set_cpu_share failed\n");
+		exit();
+	}
+	for (i = 0; i < NTHREAD; i++)
+		if (thread_create(&t[i], worker, (void*)i) < 0) {
+			printf(1, "thread_create failed\n");
+			exit();
+		}
+	start = uptime();
+	while (uptime() - start < RUNTICKS)
+		sleep(10);
+	done = 1;
+	for (i = 0; i < NTHREAD; i++)
+		thread_join(t[i], &ret);
+	for (i = 0; i < NTHREAD; i++)
+		printf(1, "thread %d: %d\n", i, count[i]);
+	printf(1, "test_lwpshare done\n");
+	exit();
+}
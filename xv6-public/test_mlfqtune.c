@@ -0,0 +1,72 @@
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "mlfq.h"
+#include "fcntl.h"
+
+// Spin long enough to use up the allotment of a level or two.
+void
+spin(void)
+{
+	volatile int i;
+
+	for (i = 0; i < 50000000; i++)
+		;
+}
+
+// Switch to five short levels, watch a cpu hog sink through
+// them, stay down while it waits on a pipe, and rise again as it
+// waits for the disk, then restore the defaults.
+int
+main(int argc, char * argv[])
+{
+	struct mlfqparam old, mp;
+	int i, fd[2];
+	char c, buf[512];
+
+	get_mlfq(&old);
+	mp.levels = 5;
+	for (i = 0; i < NMLFQ; i++) {
+		mp.quantum[i] = 1 << (i < 5 ? i : 4);
+		mp.allotment[i] = 2 * mp.quantum[i];
+	}
+	mp.boost = 500;
+	mp.wakeboost = 2;
+	if (set_mlfq(&mp) < 0) {
+		printf(1, "set_mlfq failed\n");
+		exit();
+	}
+	get_mlfq(&mp);
+	printf(1, "levels %d boost %d wakeboost %d\n", mp.levels, mp.boost, mp.wakeboost);
+
+	spin();
+	printf(1, "after spinning: level %d\n", getlev());
+
+	// Wait on a pipe, which is not I/O.
+	pipe(fd);
+	if (fork() == 0) {
+		sleep(10);
+		write(fd[1], "x", 1);
+		exit();
+	}
+	read(fd[0], &c, 1);
+	printf(1, "after pipe read: level %d\n", getlev());
+	wait();
+
+	// A file bigger than the buffer cache makes it wait for the disk.
+	spin();
+	if ((fd[0] = open("usertests", O_RDONLY)) >= 0) {
+		while (read(fd[0], buf, sizeof(buf)) > 0)
+			;
+		close(fd[0]);
+	}
+	printf(1, "after disk read: level %d\n", getlev());
+
+	mp.levels = 0;
+	if (set_mlfq(&mp) == 0)
+		printf(1, "set_mlfq accepted 0 levels\n");
+	set_mlfq(&old);
+	printf(1, "test_mlfqtune done\n");
+	exit();
+}
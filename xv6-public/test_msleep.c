@@ -0,0 +1,46 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSHORT 20
+
+// Short sleeps take about a millisecond, not a tick. Then
+// children sleep for different times at once, so the timer
+// wheel has to wake each of them at its own deadline.
+int
+main(int argc, char * argv[])
+{
+	int i, start, slept;
+	uint us;
+	int ms[] = { 10, 50, 200, 1000, 3000 };
+	int n = sizeof(ms) / sizeof(ms[0]);
+
+	us = uptime_us();
+	for (i = 0; i < NSHORT; i++)
+		msleep(1);
+	us = (uptime_us() - us) / NSHORT;
+	printf(1, "msleep(1): %d us\n", us);
+	if (us < 1000)
+		printf(1, "msleep(1) woke up too early\n");
+	else if (us >= 5000)
+		printf(1, "msleep(1) is not much finer than a tick\n");
+
+	for (i = 0; i < n; i++) {
+		if (fork() == 0) {
+			start = uptime();
+			if (msleep(ms[i]) < 0) {
+				printf(1, "msleep(%d) failed\n", ms[i]);
+				exit();
+			}
+			slept = (uptime() - start) * 10;
+			printf(1, "msleep(%d): %d ms\n", ms[i], slept);
+			if (slept < ms[i] - 10)
+				printf(1, "msleep(%d) woke up too early\n", ms[i]);
+			exit();
+		}
+	}
+	for (i = 0; i < n; i++)
+		wait();
+	printf(1, "test_msleep done\n");
+	exit();
+}
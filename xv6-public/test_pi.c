@@ -0,0 +1,66 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NHOG 4
+#define NWRITE 200
+
+char buf[512];
+
+// Spin to sink to the lowest mlfq level.
+void
+spin(int n)
+{
+	volatile int i;
+
+	for (i = 0; i < n; i++)
+		;
+}
+
+// A stride process, a low-priority mlfq writer and a writer with
+// a small cpu share contend for the inode lock of one file while
+// cpu hogs keep cpu 0 busy. With priority inheritance the stride
+// writer is not held up behind writers that barely get the cpu.
+int
+main(int argc, char * argv[])
+{
+	int fd, i, pid[NHOG + 2], start, elapsed;
+
+	set_affinity(0, 1);
+	unlink("pi.tmp");
+	if ((fd = open("pi.tmp", O_CREATE | O_RDWR)) < 0) {
+		printf(1, "open failed\n");
+		exit();
+	}
+	for (i = 0; i < NHOG; i++)
+		if ((pid[i] = fork()) == 0)
+			for (;;)
+				spin(1000000);
+	if ((pid[NHOG] = fork()) == 0) {
+		spin(50000000);
+		for (;;)
+			write(fd, buf, sizeof(buf));
+	}
+	if ((pid[NHOG + 1] = fork()) == 0) {
+		set_cpu_share(1);
+		for (;;)
+			write(fd, buf, sizeof(buf));
+	}
+
+	set_cpu_share(50);
+	start = uptime();
+	for (i = 0; i < NWRITE; i++)
+		write(fd, buf, sizeof(buf));
+	elapsed = uptime() - start;
+
+	for (i = 0; i < NHOG + 2; i++)
+		kill(pid[i]);
+	for (i = 0; i < NHOG + 2; i++)
+		wait();
+	close(fd);
+	unlink("pi.tmp");
+	printf(1, "%d writes in %d ticks\n", NWRITE, elapsed);
+	printf(1, "test_pi done\n");
+	exit();
+}
@@ -0,0 +1,68 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NTHREAD 8
+#define NROUND 200
+
+char *stacks[NTHREAD];
+
+// Touch most of the stack, so that an unmapped one would fault.
+void*
+worker(void *arg)
+{
+	char buf[4096];
+	int i;
+
+	stacks[(int)arg] = buf;
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = (int)arg;
+	thread_exit((void*)(int)buf[sizeof(buf) - 1]);
+	return 0;
+}
+
+void
+round(void)
+{
+	thread_t t[NTHREAD];
+	void *ret;
+	int i;
+
+	for (i = 0; i < NTHREAD; i++)
+		if (thread_create(&t[i], worker, (void*)i) < 0)
+			printf(1, "thread_create failed\n");
+	for (i = 0; i < NTHREAD; i++)
+		if (thread_join(t[i], &ret) < 0 || (int)ret != i)
+			printf(1, "thread %d returned %d\n", i, (int)ret);
+}
+
+// Threads are created and joined over and over; after the first
+// round their stacks come from the pool and the size stays put.
+// More threads than NSTACKIDLE exercise unmapping and remapping,
+// and a fork() copies an address space with unmapped stacks.
+// The kernel must refuse a pointer into an unmapped stack, not
+// fault on it.
+int
+main(int argc, char * argv[])
+{
+	char *sz, c;
+	int fd[2], i;
+
+	round();
+	sz = sbrk(0);
+	for (i = 0; i < NROUND; i++)
+		round();
+	if (sbrk(0) != sz)
+		printf(1, "size grew from %d to %d\n", (int)sz, (int)sbrk(0));
+	pipe(fd);
+	for (i = 0; i < NTHREAD; i++)
+		if (write(fd[1], stacks[i], 1) == 1)
+			read(fd[0], &c, 1);
+	if (fork() == 0) {
+		round();
+		exit();
+	}
+	wait();
+	printf(1, "test_stackpool done\n");
+	exit();
+}
@@ -0,0 +1,172 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+#define NTHREAD 4
+#define NITER 10000
+#define NROUND 50
+#define NITEM 1000
+
+struct uspinlock slock;
+struct mutex m;
+struct cond notempty, notfull;
+struct barrier bar;
+struct rwlock rw;
+struct once init;
+int scount, mcount, ninit, slot, full, consumed;
+int round[NTHREAD], table[2];
+
+void
+initonce(void)
+{
+	ninit++;
+}
+
+void*
+counter(void *arg)
+{
+	int i;
+
+	once(&init, initonce);
+	for (i = 0; i < NITER; i++) {
+		spin_lock(&slock);
+		scount++;
+		spin_unlock(&slock);
+		mutex_lock(&m);
+		mcount++;
+		mutex_unlock(&m);
+	}
+	thread_exit(0);
+	return 0;
+}
+
+// Each thread records its round; after the barrier, everyone
+// must have reached the same round.
+void*
+rounds(void *arg)
+{
+	int id = (int)arg, i, j;
+
+	for (i = 0; i < NROUND; i++) {
+		round[id] = i;
+		barrier_wait(&bar);
+		for (j = 0; j < NTHREAD; j++)
+			if (round[j] != i)
+				printf(1, "barrier: thread %d in round %d, not %d\n", j, round[j], i);
+		barrier_wait(&bar);
+	}
+	thread_exit(0);
+	return 0;
+}
+
+void*
+producer(void *arg)
+{
+	int i;
+
+	for (i = 1; i <= NITEM; i++) {
+		mutex_lock(&m);
+		while (full)
+			cond_wait(&notfull, &m);
+		slot = i;
+		full = 1;
+		cond_signal(&notempty);
+		mutex_unlock(&m);
+	}
+	thread_exit(0);
+	return 0;
+}
+
+void*
+consumer(void *arg)
+{
+	int i;
+
+	for (i = 1; i <= NITEM; i++) {
+		mutex_lock(&m);
+		while (!full)
+			cond_wait(&notempty, &m);
+		if (slot != i)
+			printf(1, "cond: got item %d, expected %d\n", slot, i);
+		full = 0;
+		consumed++;
+		cond_signal(&notfull);
+		mutex_unlock(&m);
+	}
+	thread_exit(0);
+	return 0;
+}
+
+// Writers keep both table entries equal; readers check them.
+void*
+rwuser(void *arg)
+{
+	int id = (int)arg, i;
+
+	for (i = 0; i < NITER / 10; i++) {
+		if (id == 0) {
+			rwlock_wrlock(&rw);
+			table[0]++;
+			table[1]++;
+			rwlock_unlock(&rw);
+		} else {
+			rwlock_rdlock(&rw);
+			if (table[0] != table[1])
+				printf(1, "rwlock: read %d and %d\n", table[0], table[1]);
+			rwlock_unlock(&rw);
+		}
+	}
+	thread_exit(0);
+	return 0;
+}
+
+void
+run(void *(*fn)(void*))
+{
+	thread_t t[NTHREAD];
+	void *ret;
+	int i;
+
+	for (i = 0; i < NTHREAD; i++)
+		thread_create(&t[i], fn, (void*)i);
+	for (i = 0; i < NTHREAD; i++)
+		thread_join(t[i], &ret);
+}
+
+int
+main(int argc, char * argv[])
+{
+	thread_t t[2];
+	void *ret;
+
+	spin_init(&slock);
+	mutex_init(&m);
+	once_init(&init);
+	run(counter);
+	if (scount != NTHREAD * NITER || mcount != NTHREAD * NITER)
+		printf(1, "counters %d and %d, expected %d\n", scount, mcount, NTHREAD * NITER);
+	if (ninit != 1)
+		printf(1, "once ran %d times\n", ninit);
+	if (mutex_trylock(&m) != 0 || mutex_trylock(&m) != -1)
+		printf(1, "mutex_trylock wrong\n");
+	mutex_unlock(&m);
+
+	barrier_init(&bar, NTHREAD);
+	run(rounds);
+
+	cond_init(&notempty);
+	cond_init(&notfull);
+	thread_create(&t[0], producer, 0);
+	thread_create(&t[1], consumer, 0);
+	thread_join(t[0], &ret);
+	thread_join(t[1], &ret);
+	if (consumed != NITEM)
+		printf(1, "consumed %d items, expected %d\n", consumed, NITEM);
+
+	rwlock_init(&rw);
+	run(rwuser);
+
+	printf(1, "test_uthread done\n");
+	exit();
+}
@@ -0,0 +1,210 @@
+// Timer wheel for sleeping processes.
+//
+// A process in sys_sleep() or sys_msleep() hangs itself on a
+// hierarchical timing wheel at its deadline and sleeps on its
+// own deadline, so the timer interrupt wakes only the processes
+// that are due instead of every sleeper on every tick.
+//
+// The wheel runs on its own clock of WHEELUS microseconds per
+// step, about a millisecond and finer than a tick, so that
+// msleep() has millisecond resolution. A power of two keeps
+// 64-bit division out of the kernel. Level l has WHEELSIZE slots covering WHEELSIZE^l
+// steps each. A timer due in less than WHEELSIZE^(l+1) steps
+// hangs on level l, and as time passes the slots of the upper
+// levels are cascaded down until the timer reaches level 0 and
+// expires.
+//
+// The wheel and the timer fields of struct proc are protected
+// by tickslock. There is no periodic tick; clockupdate() runs
+// the wheel up to the current time, stepping only to the times
+// at which it has work, and cpu 0 arms its timer for timernext().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define WHEELBITS  6
+#define WHEELSIZE  (1 << WHEELBITS)
+#define WHEELMASK  (WHEELSIZE - 1)
+#define NLEVEL     4
+#define WHEELUSBITS 10
+#define WHEELUS    (1 << WHEELUSBITS)  // microseconds per step of the wheel
+
+static struct proc *wheel[NLEVEL][WHEELSIZE];
+static uint64 wheelnow;     // Steps the wheel has run, clocknow() / WHEELUS
+
+// Hang p on the wheel at p->deadline.
+// A deadline beyond the last level waits in the last level
+// and is cascaded again until it comes into range.
+static void
+timeradd(struct proc *p)
+{
+  struct proc **slot;
+  uint delta, when;
+  int level;
+
+  delta = p->deadline - (uint)wheelnow;
+  if((int)delta < 0)
+    delta = 0;
+  when = p->deadline;
+  if(delta >= 1U << (WHEELBITS * NLEVEL))
+    when = (uint)wheelnow + (1U << (WHEELBITS * NLEVEL)) - 1;
+  for(level = 0; level < NLEVEL - 1; level++)
+    if(delta < 1U << (WHEELBITS * (level + 1)))
+      break;
+
+  slot = &wheel[level][(when >> (WHEELBITS * level)) & WHEELMASK];
+  p->tnext = *slot;
+  if(*slot)
+    (*slot)->tpprev = &p->tnext;
+  p->tpprev = slot;
+  *slot = p;
+}
+
+// Take p off the wheel, if it is there.
+static void
+timerdel(struct proc *p)
+{
+  if(p->tpprev == 0)
+    return;
+  *p->tpprev = p->tnext;
+  if(p->tnext)
+    p->tnext->tpprev = p->tpprev;
+  p->tnext = 0;
+  p->tpprev = 0;
+}
+
+// Empty a slot, and hang its timers again relative to now:
+// they move to lower levels, or wake up if they are due.
+static void
+timerflush(struct proc **slot)
+{
+  struct proc *p, *next;
+
+  p = *slot;
+  *slot = 0;
+  for(; p; p = next){
+    next = p->tnext;
+    p->tnext = 0;
+    p->tpprev = 0;
+    if((int)(p->deadline - (uint)wheelnow) <= 0)
+      wakeup(&p->deadline);
+    else
+      timeradd(p);
+  }
+}
+
+// Run one step of the wheel, at wheelnow: cascade the slot of
+// every level whose period starts now, top down, then expire
+// the current slot of level 0.
+static void
+timerstep(void)
+{
+  uint now = (uint)wheelnow;
+  int level;
+
+  for(level = 1; level < NLEVEL; level++)
+    if(now & ((1U << (WHEELBITS * level)) - 1))
+      break;
+  while(--level > 0)
+    timerflush(&wheel[level][(now >> (WHEELBITS * level)) & WHEELMASK]);
+  timerflush(&wheel[0][now & WHEELMASK]);
+}
+
+// Find the next step at which the wheel has work to do: the
+// first non-empty slot of level 0, or the next cascade of a
+// non-empty upper level. Returns 0 if the wheel is empty.
+static int
+timerfind(uint *when)
+{
+  int found, level, i;
+  uint now = (uint)wheelnow;
+  uint t;
+
+  found = 0;
+  for(i = 1; i < WHEELSIZE; i++)
+    if(wheel[0][(now + i) & WHEELMASK]){
+      *when = now + i;
+      found = 1;
+      break;
+    }
+  for(level = 1; level < NLEVEL; level++){
+    for(i = 0; i < WHEELSIZE; i++)
+      if(wheel[level][i])
+        break;
+    if(i == WHEELSIZE)
+      continue;
+    t = (now | ((1U << (WHEELBITS * level)) - 1)) + 1;
+    if(!found || (int)(t - *when) < 0)
+      *when = t;
+    found = 1;
+  }
+  return found;
+}
+
+// Run the wheel up to clocknow() value now. The steps in
+// between with nothing to do are skipped.
+// Caller must hold tickslock.
+void
+timerrun(uint64 now)
+{
+  uint64 to = now >> WHEELUSBITS;
+  uint t;
+
+  while(wheelnow < to){
+    if(!timerfind(&t) || (int)(t - (uint)to) > 0){
+      wheelnow = to;
+      break;
+    }
+    wheelnow += t - (uint)wheelnow;
+    timerstep();
+  }
+}
+
+// Find the clocknow() value at which the wheel next has work
+// to do. Returns 0 if the wheel is empty.
+// Caller must hold tickslock.
+int
+timernext(uint64 *when)
+{
+  uint t;
+
+  if(!timerfind(&t))
+    return 0;
+  *when = (wheelnow + (t - (uint)wheelnow)) << WHEELUSBITS;
+  return 1;
+}
+
+// Sleep for at least us microseconds, rounded up to a step
+// of the wheel. Return -1 if killed before the time is up.
+int
+timersleep(uint64 us)
+{
+  struct proc *p = myproc();
+  uint64 end;
+
+  if(us == 0)
+    return 0;
+  acquire(&tickslock);
+  clockupdate();
+  end = (clocknow() + us + WHEELUS - 1) >> WHEELUSBITS;
+  p->deadline = (uint)end;
+  while((int)(p->deadline - (uint)wheelnow) > 0){
+    if(p->killed){
+      timerdel(p);
+      release(&tickslock);
+      return -1;
+    }
+    if(p->tpprev == 0){
+      timeradd(p);
+      clockkick(end << WHEELUSBITS);
+    }
+    sleep(&p->deadline, &tickslock);
+  }
+  release(&tickslock);
+  return 0;
+}
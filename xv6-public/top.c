@@ -0,0 +1,136 @@
+// Show cpu utilization and the busiest processes.
+// usage: top [ticks [count]]
+// Samples the scheduler statistics every ticks (default 100)
+// count times (default 1) and prints what changed in between.
+
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "schedstat.h"
+
+#define NSHOW 10
+
+static char *states[] = { "unused", "embryo", "sleep", "runble", "run", "zombie" };
+
+struct schedstats st[2];
+
+// Print n right-aligned in a field of width w.
+static void
+pad(int n, int w)
+{
+  int len, x;
+
+  len = n < 0 ? 2 : 1;
+  for(x = n < 0 ? -n : n; x >= 10; x /= 10)
+    len++;
+  while(len++ < w)
+    printf(1, " ");
+  printf(1, "%d", n);
+}
+
+// Percentage of us in an interval of total microseconds.
+static int
+percent(uint us, uint total)
+{
+  if(total < 100)
+    return 0;
+  return us / (total / 100);
+}
+
+// The entry of pid in s, or 0.
+static struct procstat*
+find(struct schedstats *s, int pid)
+{
+  int i;
+
+  for(i = 0; i < s->nproc; i++)
+    if(s->proc[i].pid == pid)
+      return &s->proc[i];
+  return 0;
+}
+
+static void
+show(struct schedstats *old, struct schedstats *new)
+{
+  struct procstat *p, *o;
+  uint interval, run[NPROC], wait[NPROC];
+  int i, j, best, shown[NPROC];
+
+  interval = new->now - old->now;
+  for(i = 0; i < new->ncpu; i++){
+    printf(1, "cpu%d:", i);
+    pad(percent(new->cpu[i].busytime - old->cpu[i].busytime, interval), 4);
+    printf(1, "%% busy,");
+    pad(new->cpu[i].nrunnable, 3);
+    printf(1, " queued,");
+    pad(new->cpu[i].nswitch - old->cpu[i].nswitch, 6);
+    printf(1, " switches\n");
+  }
+
+  for(i = 0; i < new->nproc; i++){
+    p = &new->proc[i];
+    o = find(old, p->pid);
+    run[i] = p->runtime - (o ? o->runtime : 0);
+    wait[i] = p->waittime - (o ? o->waittime : 0);
+    shown[i] = 0;
+  }
+
+  printf(1, "  PID  TID NAME            STATE  CPU LEV GRP SHR   PASS CPU%% WAIT%%  VCSW IVCSW DEM BST\n");
+  for(j = 0; j < NSHOW; j++){
+    best = -1;
+    for(i = 0; i < new->nproc; i++)
+      if(!shown[i] && (best < 0 || run[i] > run[best]))
+        best = i;
+    if(best < 0)
+      break;
+    shown[best] = 1;
+    p = &new->proc[best];
+    pad(p->pid, 5);
+    pad(p->tid, 5);
+    printf(1, " %s", p->name);
+    for(i = strlen(p->name); i < 16; i++)
+      printf(1, " ");
+    printf(1, "%s", states[p->state]);
+    pad(p->cpu, 4);
+    pad(p->level, 4);
+    pad(p->group, 4);
+    pad(p->share, 4);
+    pad(p->pass, 7);
+    pad(percent(run[best], interval), 5);
+    pad(percent(wait[best], interval), 6);
+    pad(p->nvcsw, 6);
+    pad(p->nivcsw, 6);
+    pad(p->ndemote, 4);
+    pad(p->nboost, 4);
+    printf(1, "\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ticks, count, cur;
+
+  ticks = argc > 1 ? atoi(argv[1]) : 100;
+  count = argc > 2 ? atoi(argv[2]) : 1;
+  if(ticks <= 0 || count <= 0){
+    printf(2, "usage: top [ticks [count]]\n");
+    exit();
+  }
+
+  cur = 0;
+  if(getschedstats(&st[cur]) < 0){
+    printf(2, "top: getschedstats failed\n");
+    exit();
+  }
+  while(count-- > 0){
+    sleep(ticks);
+    cur = !cur;
+    getschedstats(&st[cur]);
+    show(&st[!cur], &st[cur]);
+    if(count > 0)
+      printf(1, "\n");
+  }
+  exit();
+}
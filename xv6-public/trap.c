@@ -3,10 +3,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -14,9 +14,6 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 
-// mlfq
-int quantum[3] = {1, 2, 4};
-
 void
 tvinit(void)
 {
@@ -51,12 +48,14 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    clockintr();
+    balancetick();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Wakes a halted cpu, makes cpu 0 re-arm its timer for
+    // a new timer, or preempts for a deadline task (see below).
+    clockarm();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -104,24 +103,12 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU at the end of its slice.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER) {
-	  struct proc *p = myproc();
-	  // if process is in mlfq
-	  // stride have not to check
-	  if (p->cpu_share == 0) {
-		  acquire(&tickslock);
-		  p->ticks++;
-		  totalticks++;
-		  release(&tickslock);
-		  // check quantum
-		  if (p->ticks % quantum[p->level] != 0)
-			  return;
-	  }
-	  yield();
-  }
+     (tf->trapno == T_IRQ0+IRQ_TIMER || tf->trapno == T_IRQ0+IRQ_RESCHED) &&
+     clockexpired())
+    yield();
 
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
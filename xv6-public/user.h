@@ -1,5 +1,13 @@
 struct stat;
 struct rtcdate;
+struct schedstats;
+struct mlfqparam;
+struct uspinlock;
+struct mutex;
+struct cond;
+struct barrier;
+struct rwlock;
+struct once;
 
 // system calls
 int fork(void);
@@ -31,6 +39,20 @@ int set_cpu_share(int);
 int thread_create(thread_t*, void*, void*);
 void thread_exit(void*) __attribute__((noreturn));
 int thread_join(thread_t, void**);
+int msleep(int);
+int set_affinity(int, int);
+int get_affinity(int);
+int set_deadline(int, int, int);
+int group_create(int);
+int group_join(int, int);
+int group_destroy(int);
+int set_gang(int);
+int getschedstats(struct schedstats*);
+uint uptime_us(void);
+int set_mlfq(struct mlfqparam*);
+int get_mlfq(struct mlfqparam*);
+int futex_wait(volatile int*, int);
+int futex_wake(volatile int*, int);
 
 
 // ulib.c
@@ -46,3 +68,24 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+
+// uthread.c
+void spin_init(struct uspinlock*);
+void spin_lock(struct uspinlock*);
+void spin_unlock(struct uspinlock*);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void barrier_init(struct barrier*, int);
+int barrier_wait(struct barrier*);
+void rwlock_init(struct rwlock*);
+void rwlock_rdlock(struct rwlock*);
+void rwlock_wrlock(struct rwlock*);
+void rwlock_unlock(struct rwlock*);
+void once_init(struct once*);
+void once(struct once*, void (*)(void));
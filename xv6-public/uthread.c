@@ -0,0 +1,235 @@
+// Synchronization for LWPs: spinlocks, adaptive mutexes,
+// condition variables, barriers, read-write locks and once.
+// Uncontended operations stay in user space; a thread that
+// has to wait sleeps in futex_wait() instead of spinning.
+
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+#include "uthread.h"
+
+#define SPINS 100        // Tries before a mutex sleeps
+#define WAKEALL 0x7fffffff
+
+static uint
+cas(volatile uint *addr, uint old, uint new)
+{
+  return __sync_val_compare_and_swap(addr, old, new);
+}
+
+void
+spin_init(struct uspinlock *lk)
+{
+  lk->locked = 0;
+}
+
+void
+spin_lock(struct uspinlock *lk)
+{
+  while(xchg(&lk->locked, 1) != 0)
+    ;
+}
+
+void
+spin_unlock(struct uspinlock *lk)
+{
+  xchg(&lk->locked, 0);
+}
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+// Spin a little in case the holder is about to release the
+// mutex, then sleep. A sleeper marks the mutex 2 so that
+// mutex_unlock() knows it must wake someone.
+void
+mutex_lock(struct mutex *m)
+{
+  uint c = 1;
+  int i;
+
+  for(i = 0; i < SPINS; i++){
+    if((c = cas(&m->state, 0, 1)) == 0)
+      return;
+    if(c == 2)
+      break;
+  }
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait((volatile int*)&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+// Returns 0 if it got the mutex, -1 if the mutex is held.
+int
+mutex_trylock(struct mutex *m)
+{
+  return cas(&m->state, 0, 1) == 0 ? 0 : -1;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    m->state = 0;
+    futex_wake((volatile int*)&m->state, 1);
+  }
+}
+
+void
+cond_init(struct cond *cv)
+{
+  cv->seq = 0;
+  cv->waiters = 0;
+}
+
+// Release m, wait for a signal, and take m again.
+// As with any condition variable, recheck the condition.
+void
+cond_wait(struct cond *cv, struct mutex *m)
+{
+  uint seq = cv->seq;
+
+  __sync_fetch_and_add(&cv->waiters, 1);
+  mutex_unlock(m);
+  futex_wait((volatile int*)&cv->seq, seq);
+  __sync_fetch_and_sub(&cv->waiters, 1);
+  // Others may be waiting for m too, so take it as contended.
+  while(xchg(&m->state, 2) != 0)
+    futex_wait((volatile int*)&m->state, 2);
+}
+
+void
+cond_signal(struct cond *cv)
+{
+  if(cv->waiters == 0)
+    return;
+  __sync_fetch_and_add(&cv->seq, 1);
+  futex_wake((volatile int*)&cv->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *cv)
+{
+  if(cv->waiters == 0)
+    return;
+  __sync_fetch_and_add(&cv->seq, 1);
+  futex_wake((volatile int*)&cv->seq, WAKEALL);
+}
+
+void
+barrier_init(struct barrier *b, int n)
+{
+  b->total = n;
+  b->count = 0;
+  b->round = 0;
+  b->sleepers = 0;
+}
+
+// Wait until total threads have called barrier_wait().
+// Returns 1 in the last thread to arrive, 0 in the others.
+int
+barrier_wait(struct barrier *b)
+{
+  uint round = b->round;
+  int i;
+
+  if(__sync_add_and_fetch(&b->count, 1) == b->total){
+    b->count = 0;
+    __sync_fetch_and_add(&b->round, 1);
+    if(b->sleepers)
+      futex_wake((volatile int*)&b->round, WAKEALL);
+    return 1;
+  }
+  for(i = 0; i < SPINS; i++)
+    if(b->round != round)
+      return 0;
+  __sync_fetch_and_add(&b->sleepers, 1);
+  while(b->round == round)
+    futex_wait((volatile int*)&b->round, round);
+  __sync_fetch_and_sub(&b->sleepers, 1);
+  return 0;
+}
+
+// Writers go first: once a writer waits, new readers wait too.
+void
+rwlock_init(struct rwlock *rw)
+{
+  mutex_init(&rw->lock);
+  cond_init(&rw->readers);
+  cond_init(&rw->writers);
+  rw->nreaders = 0;
+  rw->writer = 0;
+  rw->wwaiting = 0;
+}
+
+void
+rwlock_rdlock(struct rwlock *rw)
+{
+  mutex_lock(&rw->lock);
+  while(rw->writer || rw->wwaiting)
+    cond_wait(&rw->readers, &rw->lock);
+  rw->nreaders++;
+  mutex_unlock(&rw->lock);
+}
+
+void
+rwlock_wrlock(struct rwlock *rw)
+{
+  mutex_lock(&rw->lock);
+  rw->wwaiting++;
+  while(rw->writer || rw->nreaders)
+    cond_wait(&rw->writers, &rw->lock);
+  rw->wwaiting--;
+  rw->writer = 1;
+  mutex_unlock(&rw->lock);
+}
+
+void
+rwlock_unlock(struct rwlock *rw)
+{
+  mutex_lock(&rw->lock);
+  if(rw->writer)
+    rw->writer = 0;
+  else
+    rw->nreaders--;
+  if(rw->wwaiting){
+    if(rw->nreaders == 0)
+      cond_signal(&rw->writers);
+  } else
+    cond_broadcast(&rw->readers);
+  mutex_unlock(&rw->lock);
+}
+
+void
+once_init(struct once *o)
+{
+  o->state = 0;
+}
+
+// Run fn exactly once; everyone calling once() on o returns
+// after fn has returned.
+void
+once(struct once *o, void (*fn)(void))
+{
+  uint c;
+
+  if(o->state == 3)
+    return;
+  if(cas(&o->state, 0, 1) == 0){
+    fn();
+    if(xchg(&o->state, 3) == 2)
+      futex_wake((volatile int*)&o->state, WAKEALL);
+    return;
+  }
+  while((c = o->state) != 3){
+    if(c == 1 && cas(&o->state, 1, 2) != 1)
+      continue;
+    futex_wait((volatile int*)&o->state, 2);
+  }
+}
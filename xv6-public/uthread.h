@@ -0,0 +1,35 @@
+// Synchronization for LWPs, see uthread.c.
+// Initialize each object with its _init function before use.
+
+struct uspinlock {
+  volatile uint locked;
+};
+
+struct mutex {
+  volatile uint state;     // 0 unlocked, 1 locked, 2 locked with sleepers
+};
+
+struct cond {
+  volatile uint seq;       // Bumped by every signal
+  volatile uint waiters;   // Threads in cond_wait()
+};
+
+struct barrier {
+  uint total;              // Threads to wait for
+  volatile uint count;     // Threads arrived in this round
+  volatile uint round;     // Bumped when a round completes
+  volatile uint sleepers;  // Threads asleep in barrier_wait()
+};
+
+struct rwlock {
+  struct mutex lock;       // Protects the fields below
+  struct cond readers;
+  struct cond writers;
+  int nreaders;            // Readers holding the lock
+  int writer;              // Is a writer holding the lock?
+  int wwaiting;            // Writers waiting for the lock
+};
+
+struct once {
+  volatile uint state;     // 0 not run, 1 running, 2 running with sleepers, 3 done
+};